@@ -15,6 +15,11 @@
 Adafruit_AM2315 am2315;
 
 #include <my_relay.h>
+#include <my_arena.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
@@ -47,7 +52,7 @@ const int GPIO2_PIN=2;
 
 char msg[40];
 StaticJsonDocument<200> doc;
-Relay * lvLights = new Relay(TX_PIN);
+Relay * lvLights = STATIC_NEW(Relay, TX_PIN);
 
 Adafruit_VEML7700 veml = Adafruit_VEML7700();
 
@@ -56,6 +61,14 @@ bool thermoSensorFound = false;
 int16_t lightLevel = 0;
 float temperature, humidity = -1;
 
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase sensorPhase("sensors");
+
 void setup() {
   Serial.begin(9600);
   Serial.println("Booting up");
@@ -91,7 +104,11 @@ void setup() {
   server.on("/light", handleLight);
   server.on("/status", handleStatus);
   server.on("/sensors", handleSensors);
+  server.on("/metrics", handleMetrics);
   server.begin();
+
+  setupMetrics();
+
   syslog.appName(LIGHT_APPNAME);
   int attempts = 0; 
   while (attempts < 10) {
@@ -236,10 +253,29 @@ void handleStatus() {
 }
 
 
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&sensorPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
 time_t prevTime = 0;;
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   time_t now = time(nullptr);
   if ( now != prevTime ) {
@@ -262,4 +298,10 @@ void loop() {
     }
     prevTime = now;
   } 
+  loopTimer.lap(sensorPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
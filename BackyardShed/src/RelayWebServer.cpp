@@ -10,9 +10,19 @@
 #include <Vector.h>
 #include <Wire.h>
 #include "Adafruit_MCP23X17.h"
+#include <my_mcp.h>
+#include <my_i2cbus.h>
 
 #include <my_relay.h>
+#include <my_scheduler.h>
 #include <my_veml.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_logqueue.h>
+#include <my_journal.h>
+#include <my_router.h>
 #include "irrigation_config.h"
 
 #include <time.h>                       // time() ctime()
@@ -23,8 +33,11 @@
 // This device info
 #define JSON_SIZE 1500
 #define MYTZ TZ_America_Los_Angeles
+// longest loop() will sleep waiting for a relay, keeps HTTP and OTA responsive
+#define MAX_IDLE_MS 2
 
 ESP8266WebServer server(80);
+CommandRouter<ESP8266WebServer> router(server);
 /* TODO
  - Add enable/disable schedule function and make it persist reboots
  - Finish cleaning up logging
@@ -44,7 +57,9 @@ ESP8266WebServer server(80);
 #define LIGHTSWITCH_APPNAME "lightswitch"
 #define IRRIGATION_APPNAME "irrigation"
 WiFiUDP udpClient;
-Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+Syslog syslogUdp(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+// messages wait here and go out from the end of loop()
+LogQueue syslog(syslogUdp, SYSTEM_APPNAME);
 
 Veml veml;
 
@@ -54,14 +69,55 @@ const int RX_PIN=3;
 const int GPIO0_PIN=0;
 const int GPIO2_PIN=2;
 const int REED_PIN = 15;
+const uint8_t MCP_ADDRESS = 0x20;
+const uint8_t VEML_ADDRESS = 0x10;
 
 int debug = 0;
 StaticJsonDocument<200> doc;
+I2CBus i2cBus;
 Adafruit_MCP23X17 mcp;
-Vector<IrrigationRelay*> IrrigationZones;
-IrrigationRelay * storage_array[NUM_IRRIGATION_ZONES];
-
-//ReedSwitch * shedDoor = new ReedSwitch(REED_PIN, &mcp);
+McpPort mcpPort(&mcp);
+IrrigationZoneSet irrigationZoneSet(&mcpPort);
+Vector<McpIrrigationRelay*> IrrigationZones;
+McpIrrigationRelay * storage_array[NUM_IRRIGATION_ZONES];
+RelayScheduler scheduler;
+RelayScheduler::Entry scheduler_storage[NUM_IRRIGATION_ZONES];
+
+MetricRegistry metrics;
+Gauge zoneOnGauges[NUM_IRRIGATION_ZONES];
+Gauge zoneMoistureGauges[NUM_IRRIGATION_ZONES];
+Counter zoneRunCounters[NUM_IRRIGATION_ZONES];
+Gauge lightGauge("irrigation_light_lux", "Ambient light.");
+Counter i2cRecoveryCounter("irrigation_i2c_recoveries_total", "Times the I2C bus was unstuck.");
+Counter mcpWriteCounter("irrigation_mcp_writes_total", "Expander port writes.");
+Counter syslogDropCounter("syslog_dropped_total", "Log messages dropped with the queue full.");
+Counter syslogTruncateCounter("syslog_truncated_total", "Log messages cut short to fit the queue.");
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase sensorPhase("sensors");
+LoopPhase relayPhase("relays");
+LoopPhase syslogPhase("syslog");
+
+// switches, doors and sensor alarms, for /events
+EventJournal journal;
+
+//ReedSwitch * shedDoor = new ReedSwitch(REED_PIN, &mcpPort);
+
+// what /status?fields= can ask for, a bit each in this order; without it,
+// all of them
+enum StatusField : uint8_t {
+  FIELD_ACTIVE, FIELD_STATE, FIELD_OVERRIDE, FIELD_MOISTURE, FIELD_PERCENT,
+  FIELD_LEFT, FIELD_LAST, FIELD_NEXT, FIELD_WEEK, FIELD_SENSORS, FIELD_DEBUG, FIELD_TIME
+};
+const char* const STATUS_FIELDS[] = {
+  "active", "state", "override", "moisture", "percent",
+  "left", "last", "next", "week", "sensors", "debug", "time"
+};
+#define STATUS_FIELD_COUNT (sizeof(STATUS_FIELDS) / sizeof(STATUS_FIELDS[0]))
+#define ALL_STATUS_FIELDS ((1UL << STATUS_FIELD_COUNT) - 1)
 
 void handleHelp() {
   String helpMessage = "/help";
@@ -69,45 +125,35 @@ void handleHelp() {
   helpMessage += "/debug?level=status\n";
   helpMessage += "/debug?level=[012]\n";
   helpMessage += "\n";
-  helpMessage += "/status?zone=[<zone>]\n";
+  helpMessage += "/status?zone=[<zone>|all]&fields=[<field>,...]\n";
   helpMessage += "/irrigation?zone=[<zone>]&state=[on|off|status]\n";
+  helpMessage += "/metrics\n";
+  helpMessage += "/timing?reset=[1]\n";
+  helpMessage += "/events?since=[<seq>]\n";
   helpMessage += "\n";
   helpMessage += "zones:";
-  for (IrrigationRelay * relay : IrrigationZones) {
+  for (McpIrrigationRelay * relay : IrrigationZones) {
     helpMessage = helpMessage + " " + relay->name;
   }
   helpMessage += "\n";
+  helpMessage += "fields:";
+  for (const char* field : STATUS_FIELDS) {
+    helpMessage = helpMessage + " " + field;
+  }
+  helpMessage += "\n";
 
   server.send(200, "text/plain", helpMessage);
 }
 
 void handleDebug() {
-  if (server.arg("level") == "status") {
-    char msg[40];
-    sprintf(msg, "Debug level: %d", debug);
-    server.send(200, "text/plain",msg);
-  } else if (server.arg("level") == "0") {
-    syslog.log(LOG_INFO, "Debug level 0");
-    debug = 0;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "1") {
-    syslog.log(LOG_INFO, "Debug level 1");
-    debug = 1;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "2") {
-    syslog.log(LOG_INFO, "Debug level 2");
-    debug = 2;
-    server.send(200, "text/plain");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown debug command");
-  }
+  router.dispatchDebug(debug, syslog);
 }
 
 void handleZones() {
   String zones;
 
   bool first = true;
-  for (IrrigationRelay * relay : IrrigationZones) {
+  for (McpIrrigationRelay * relay : IrrigationZones) {
     if ( first ) {
       zones = relay->name;
       first = false;
@@ -131,7 +177,7 @@ void handleDoor() {
 void handleSensors() {
   if (server.arg("sensor") == "light") {
     char msg[10];
-    sprintf(msg, "%d", veml.readLux());
+    sprintf(msg, "%d", veml.lux);
     server.send(200, "text/plain", msg);
   } 
 
@@ -142,67 +188,118 @@ void handleSensors() {
   */
 }
 
-IrrigationRelay* findZoneByName(const String& zoneName) {
-  for (IrrigationRelay* relay : IrrigationZones) {
-    if (zoneName == relay->name) return relay;
+McpIrrigationRelay* findZoneByName(const char* zoneName) {
+  for (McpIrrigationRelay* relay : IrrigationZones) {
+    if (strcmp(zoneName, relay->name) == 0) return relay;
   }
   return nullptr;
 }
 
+// a comma separated list of STATUS_FIELDS as a mask; false when one of
+// them isn't
+bool parseStatusFields(const char* list, unsigned long& fields) {
+  fields = 0;
+  while (*list) {
+    const char* end = strchr(list, ',');
+    size_t length = end ? end - list : strlen(list);
+    uint8_t f = 0;
+    while (f < STATUS_FIELD_COUNT && !(strlen(STATUS_FIELDS[f]) == length && strncmp(list, STATUS_FIELDS[f], length) == 0)) f++;
+    if (f == STATUS_FIELD_COUNT) return false;
+    fields |= 1UL << f;
+    list += end ? length + 1 : length;
+  }
+  return fields != 0;
+}
+
+#define HAS_FIELD(f) (fields & (1UL << (f)))
+
+void writeZoneStatus(JsonStream& json, McpIrrigationRelay* relay, unsigned long fields) {
+  char buf[PRETTY_TIME_SIZE];
+  json.beginObject(relay->name);
+  if (HAS_FIELD(FIELD_ACTIVE)) json.add("Active", relay->active);
+  if (HAS_FIELD(FIELD_STATE)) json.add("State", relay->state());
+  if (HAS_FIELD(FIELD_OVERRIDE)) json.add("Override", relay->scheduleOverride);
+  if (HAS_FIELD(FIELD_MOISTURE)) json.add("Moisture Level", relay->moistureLevel);
+  if (HAS_FIELD(FIELD_PERCENT)) json.add("Moisture Percentage", relay->moisturePercentage);
+  if (HAS_FIELD(FIELD_LEFT)) json.add("Time Left", relay->timeLeftToRun(buf));
+  if (HAS_FIELD(FIELD_LAST)) json.add("Last Run Time", relay->prettyOnTime(buf));
+  if (HAS_FIELD(FIELD_NEXT)) json.add("Next Run Time", relay->nextTimeToRun(buf));
+  if (HAS_FIELD(FIELD_WEEK)) {
+    char weekSchedule[8];
+    relay->getWeekSchedule(weekSchedule);
+    json.add("Week Schedule", weekSchedule);
+  }
+  json.endObject();
+}
+
+// One zone, or with no zone or zone=all every one of them, in a single
+// document with the sensors and the clock, so a dashboard polls once
+// instead of once per zone.
 void handleStatus() {
   time_t now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
 
-  IrrigationRelay* relay = findZoneByName(server.arg("zone"));
-  if (!relay) {
-    char msg[60];
-    sprintf(msg, "ERROR: irrigation zone %s not found", server.arg("zone").c_str());
-    server.send(404, "text/plain", msg);
+  const String& zoneArg = server.arg("zone");
+  McpIrrigationRelay* relay = nullptr;
+  if (zoneArg.length() > 0 && zoneArg != "all") {
+    relay = findZoneByName(zoneArg.c_str());
+    if (!relay) {
+      char msg[60];
+      snprintf(msg, sizeof(msg), "ERROR: irrigation zone %s not found", zoneArg.c_str());
+      server.send(404, "text/plain", msg);
+      return;
+    }
+  }
+
+  unsigned long fields = ALL_STATUS_FIELDS;
+  const String& fieldsArg = server.arg("fields");
+  if (fieldsArg.length() > 0 && !parseStatusFields(fieldsArg.c_str(), fields)) {
+    server.send(404, "text/plain", "ERROR: unknown status field, see /help");
     return;
   }
 
-  JsonObject switches = doc.createNestedObject("switches");
-  JsonObject sensors = doc.createNestedObject("sensors");
-
-  switches[relay->name]["Active"] = relay->active;
-  switches[relay->name]["State"] = relay->state();
-  switches[relay->name]["Override"] = relay->scheduleOverride;
-  switches[relay->name]["Moisture Level"] = relay->moistureLevel;
-  switches[relay->name]["Moisture Percentage"] = relay->moisturePercentage;
-  switches[relay->name]["Time Left"] = relay->timeLeftToRun;
-  switches[relay->name]["Last Run Time"] = relay->prettyOnTime;
-  switches[relay->name]["Next Run Time"] = relay->nextTimeToRun;
-  char weekSchedule[8];
-  relay->getWeekSchedule(weekSchedule);
-  switches[relay->name]["Week Schedule"] = weekSchedule;
-
-  sensors["Light Level"] = veml.readLux();
-  doc["debug"] = debug;
-
-  char timeString[20];
-  struct tm *timeinfo = localtime(&now);
-  strftime(timeString, 20, "%D %T", timeinfo);
-  doc["time"] = timeString;
-
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+
+  json.beginObject("switches");
+  if (relay) {
+    writeZoneStatus(json, relay, fields);
   } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(200, "text/plain", httpResponse);
+    for (McpIrrigationRelay * zone : IrrigationZones) writeZoneStatus(json, zone, fields);
+  }
+  json.endObject();
+
+  if (HAS_FIELD(FIELD_SENSORS)) {
+    json.beginObject("sensors");
+    json.add("Light Level", veml.lux);
+    json.add("Light Age (ms)", veml.sampleAge());
+    json.endObject();
   }
+  if (HAS_FIELD(FIELD_DEBUG)) json.add("debug", debug);
+
+  if (HAS_FIELD(FIELD_TIME)) {
+    char timeString[20];
+    struct tm *timeinfo = localtime(&now);
+    strftime(timeString, 20, "%D %T", timeinfo);
+    json.add("time", timeString);
+  }
+
+  json.endObject();
+  response.end();
 }
 
 void logIrrigation(const char* msg) {
-  syslog.appName(IRRIGATION_APPNAME);
-  syslog.log(LOG_INFO, msg);
-  syslog.appName(SYSTEM_APPNAME);
+  syslog.log(IRRIGATION_APPNAME, LOG_INFO, msg);
 }
 
-void logIrrigationEvent(IrrigationRelay * relay, const char* trigger) {
+void logIrrigationEvent(McpIrrigationRelay * relay, const char* trigger) {
+  if (relay->on) {
+    for (uint8_t i = 0; i < IrrigationZones.size(); i++) {
+      if (IrrigationZones[i] == relay) zoneRunCounters[i].inc();
+    }
+  }
+
   StaticJsonDocument<JSON_SIZE> doc;
   doc["unit"] ="backyard";
   doc["trigger"] = trigger;
@@ -214,49 +311,151 @@ void logIrrigationEvent(IrrigationRelay * relay, const char* trigger) {
   String logMessage;
   serializeJson(doc, logMessage);
   logIrrigation(logMessage.c_str());
+  journal.record(relay->name, relay->on ? EVENT_ON : EVENT_OFF, relay->on ? relay->runTime : 0);
+}
+
+// the scheduler only holds irrigation zones
+void logScheduledChange(RelayBase * relay) {
+  logIrrigationEvent(static_cast<McpIrrigationRelay*>(relay), "schedule");
+}
+
+enum IrrigationArg : uint8_t { ARG_ZONE, ARG_STATE, ARG_OVERRIDE };
+enum OverrideChoice : int8_t { OVERRIDE_TRUE, OVERRIDE_FALSE };
+const char* const OVERRIDE_CHOICES[] = { "true", "false" };
+const RouteParam IRRIGATION_PARAMS[] = {
+  { "zone", nullptr, 0 },
+  { "state", ROUTE_TABLE(SWITCH_CHOICES) },
+  { "override", ROUTE_TABLE(OVERRIDE_CHOICES) },
+};
+
+void setZoneOverride(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  bool override = args.choice(ARG_OVERRIDE) == OVERRIDE_TRUE;
+  relay->setScheduleOverride(override);
+  char msg[60];
+  sprintf(msg, "Schedule %s for irrigation zone %s by API request", override ? "disabled" : "enabled", relay->name);
+  logIrrigation(msg);
+  server.send(200, "text/plain");
+}
+
+void switchZone(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  if (args.choice(ARG_STATE) == SWITCH_ON) {
+    relay->switchOn();
+  } else {
+    relay->switchOff();
+  }
+  //TODO: log events should only be when state changes
+  logIrrigationEvent(relay, "API");
+  server.send(200, "text/plain");
 }
 
+void sendZoneState(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  server.send(200, "text/plain", relay->status() ? "1" : "0");
+}
+
+const RouteCommand IRRIGATION_COMMANDS[] = {
+  { ARG_OVERRIDE, ROUTE_ANY, setZoneOverride },
+  { ARG_STATE, SWITCH_STATUS, sendZoneState },
+  { ARG_STATE, ROUTE_ANY, switchZone },
+};
+const Route IRRIGATION_ROUTE = { ROUTE_TABLE(IRRIGATION_PARAMS), ROUTE_TABLE(IRRIGATION_COMMANDS), "ERROR: state command not specified" };
+
 void handleIrrigation() {
-  IrrigationRelay* relay = findZoneByName(server.arg("zone"));
+  RouteArgs args;
+  router.parse(IRRIGATION_ROUTE, args);
+
+  McpIrrigationRelay* relay = findZoneByName(args.text(ARG_ZONE));
   if (!relay) {
     char msg[60];
-    sprintf(msg, "ERROR: irrigation zone %s not found", server.arg("zone").c_str());
+    sprintf(msg, "ERROR: irrigation zone %s not found", args.text(ARG_ZONE));
     server.send(404, "text/plain", msg);
     return;
   }
 
   if (debug) {
-    syslog.logf(LOG_INFO, "DEBUG: irrigation handling: zone arg: %s, relay name: %s", server.arg("zone").c_str(), relay->name);
+    syslog.logf(LOG_INFO, "DEBUG: irrigation handling: zone arg: %s, relay name: %s", args.text(ARG_ZONE), relay->name);
   }
 
-  if (server.arg("override") == "true") {
-    relay->setScheduleOverride(true);
-    char msg[60];
-    sprintf(msg, "Schedule disabled for irrigation zone %s by API request", relay->name);
-    logIrrigation(msg);
-    server.send(200, "text/plain");
-  } else if (server.arg("override") == "false") {
-    relay->setScheduleOverride(false);
-    char msg[60];
-    sprintf(msg, "Schedule enabled for irrigation zone %s by API request", relay->name);
-    logIrrigation(msg);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "status") {
-    server.send(200, "text/plain", relay->status() ? "1" : "0");
-  } else if (server.arg("state") == "on") {
-    relay->switchOn();
-    //TODO: log events should only be when state changes
-    logIrrigationEvent(relay, "API");
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "off") {
-    relay->switchOff();
-    logIrrigationEvent(relay, "API");
-    server.send(200, "text/plain");
-  } else {
-    char msg[40];
-    sprintf(msg, "ERROR: state command not specified for %s", relay->name);
-    server.send(404, "text/plain", msg);
+  char unknown[60];
+  snprintf(unknown, sizeof(unknown), "ERROR: state command not specified for %s", relay->name);
+  args.context = relay;
+  router.run(IRRIGATION_ROUTE, args, unknown);
+}
+
+// a gauge for each zone's state and moisture, read from the relay at scrape
+// time, and a count of its runs
+void setupMetrics() {
+  for (uint8_t i = 0; i < IrrigationZones.size(); i++) {
+    McpIrrigationRelay * relay = IrrigationZones[i];
+
+    zoneOnGauges[i].setup("irrigation_zone_on", "1 while the zone is watering.");
+    zoneOnGauges[i].setLabel("zone", relay->name);
+    zoneOnGauges[i].setSource([](void* r) { return (double) static_cast<McpIrrigationRelay*>(r)->on; }, relay);
+    metrics.add(&zoneOnGauges[i]);
+
+    zoneMoistureGauges[i].setup("irrigation_zone_moisture_percent", "Soil moisture, -1 without a sensor.");
+    zoneMoistureGauges[i].setLabel("zone", relay->name);
+    zoneMoistureGauges[i].setSource([](void* r) { return (double) static_cast<McpIrrigationRelay*>(r)->moisturePercentage; }, relay);
+    metrics.add(&zoneMoistureGauges[i]);
+
+    zoneRunCounters[i].setup("irrigation_zone_runs_total", "Runs started by the schedule or the API.");
+    zoneRunCounters[i].setLabel("zone", relay->name);
+    metrics.add(&zoneRunCounters[i]);
   }
+
+  lightGauge.setSource([](void*) { return (double) veml.lux; });
+  metrics.add(&lightGauge);
+  i2cRecoveryCounter.setSource([](void*) { return (double) i2cBus.recoveries; });
+  metrics.add(&i2cRecoveryCounter);
+  mcpWriteCounter.setSource([](void*) { return (double) mcpPort.busWrites; });
+  metrics.add(&mcpWriteCounter);
+  syslogDropCounter.setSource([](void*) { return (double) syslog.dropped; });
+  metrics.add(&syslogDropCounter);
+  syslogTruncateCounter.setSource([](void*) { return (double) syslog.truncated; });
+  metrics.add(&syslogTruncateCounter);
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&sensorPhase);
+  loopTimer.add(&relayPhase);
+  loopTimer.add(&syslogPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
+// where loop() spends its time, with the max and p99 of each phase
+void handleTiming() {
+  if (server.arg("reset") == "1") loopTimer.reset();
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+  loopTimer.writeJson(json);
+  json.endObject();
+  response.end();
+}
+
+// the events after ?since=, oldest first; poll again with the last seq seen
+void handleEvents() {
+  uint32_t since = strtoul(server.arg("since").c_str(), nullptr, 10);
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response, false);
+  json.beginObject();
+  journal.writeJson(json, since);
+  json.endObject();
+  response.end();
 }
 
 void setup() {
@@ -279,17 +478,26 @@ void setup() {
   sprintf(msg, "Alive! at IP: %s", (char*) WiFi.localIP().toString().c_str());
   Serial.println(msg);
   syslog.log(LOG_INFO, msg);
+  journal.begin(ESP.random());
+  journal.record(SYSTEM_APPNAME, EVENT_BOOT);
 
   // Setup OTA Update
+  // the update ends in a reboot, send what is still queued first
+  ArduinoOTA.onStart([]() { syslog.flush(); });
   ArduinoOTA.begin();
 
   configTime(MYTZ, "pool.ntp.org");
 
-  // set I2C pins (SDA, SDL)
-  Wire.begin(GPIO0_PIN, GPIO2_PIN);
-  if (!mcp.begin_I2C()) {
+  // set I2C pins (SDA, SDL); the MCP and VEML both take 400kHz
+  if ( ! i2cBus.begin(GPIO0_PIN, GPIO2_PIN) ) {
+    syslog.log(LOG_ERR, "ERROR: I2C bus stuck at boot");
+  }
+  i2cBus.addDevice(MCP_ADDRESS, I2C_MCP23X17_MAX);
+  i2cBus.addDevice(VEML_ADDRESS, I2C_FAST_MODE);
+  if (!mcp.begin_I2C(MCP_ADDRESS)) {
     syslog.log(LOG_INFO, "ERROR: MCP setup failed");
   }
+  mcpPort.begin();
 
   if ( ! veml.setup() ) {
     syslog.log(LOG_INFO, "ERROR: veml setup failed");
@@ -308,7 +516,13 @@ void setup() {
   IrrigationZones.setStorage(storage_array);
 
   // Initialize irrigation zones from configuration
-  setupIrrigationZones(IrrigationZones, &mcp);
+  setupIrrigationZones(IrrigationZones, irrigationZoneSet);
+
+  scheduler.setStorage(scheduler_storage);
+  for (McpIrrigationRelay * relay : IrrigationZones) {
+    scheduler.add(relay);
+  }
+  setupMetrics();
 
   // Start the server
   server.on("/help", handleHelp);
@@ -318,13 +532,16 @@ void setup() {
   //server.on("/door", handleDoor);
   server.on("/sensors", handleSensors);
   server.on("/status", handleStatus);
+  server.on("/metrics", handleMetrics);
+  server.on("/timing", handleTiming);
+  server.on("/events", handleEvents);
 
   server.begin();
   Serial.println("End of setup");
 
 /*
   // Disable the zones
-  for (IrrigationRelay * relay : IrrigationZones) {
+  for (McpIrrigationRelay * relay : IrrigationZones) {
     relay->setInActive();
   }
 */
@@ -333,8 +550,11 @@ void setup() {
 
 time_t prevTime = 0;;
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   time_t now = time(nullptr);
   /*
@@ -346,9 +566,28 @@ void loop() {
   */
   prevTime = now;
 
-  for (IrrigationRelay * relay : IrrigationZones) {
-    if ( relay->handle() ) {
-      logIrrigationEvent(relay, "schedule");
-    }
+  // pick up a finished light sample for the handlers to serve
+  i2cBus.call(VEML_ADDRESS, []() { return veml.handle() ? I2C_DONE : I2C_IDLE; });
+  loopTimer.lap(sensorPhase);
+
+  // only the zones that are due get handled
+  scheduler.run(logScheduledChange);
+
+  // one bus write for whatever the zones switched this pass
+  i2cBus.call(MCP_ADDRESS, []() { return mcpPort.sync() ? I2C_DONE : I2C_IDLE; });
+  loopTimer.lap(relayPhase);
+
+  // logs go out of the time the zones don't need
+  syslog.handle();
+  loopTimer.lap(syslogPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
   }
+
+  // rest while no zone is due, outside the timed pass and short enough
+  // that requests, OTA and the light sample don't wait on it
+  unsigned long idle = scheduler.idleMillis();
+  if (idle > 0) loopTimer.idle(idle < MAX_IDLE_MS ? idle : MAX_IDLE_MS);
 }
@@ -1,7 +1,7 @@
 #ifndef IRRIGATION_CONFIG_H
 #define IRRIGATION_CONFIG_H
 
-#include "Adafruit_MCP23X17.h"
+#include <utility>
 #include <my_relay.h>
 #include <Vector.h>
 
@@ -10,48 +10,61 @@ struct IrrigationZoneConfig {
   const char* name;
   uint8_t pin;
   bool backwards;
-  const char* startTime;
+  int startMinute;              // minuteOfDay("7:00"), worked out at compile time
   uint8_t durationMinutes;
   bool everyOtherDay;
 };
 
 // Irrigation zone configurations
 // Edit this array to add, remove, or modify irrigation zones
-const IrrigationZoneConfig IRRIGATION_ZONES[] = {
-  // name,          pin, backwards, startTime, duration, everyOtherDay
-  {"patio_pots",      7,     true,    "7:00",        3,        false},
-  {"cottage",         6,     true,    "7:15",       15,         true},
-  {"south_fence",     5,     true,    "7:30",        5,        false},
-  {"hill",            4,     true,    "7:45",       15,        false},
-  {"back_pots",       3,     true,    "8:15",       10,        false},
-  {"back_fence",      2,     true,    "8:30",       15,        false},
-  {"north_fence",     1,     true,    "8:45",       15,         true},
-  {"unused_0",        0,     true,    "8:30",        5,         true}
+constexpr IrrigationZoneConfig IRRIGATION_ZONES[] = {
+  // name,          pin, backwards, startTime,              duration, everyOtherDay
+  {"patio_pots",      7,     true,    minuteOfDay("7:00"),        3,        false},
+  {"cottage",         6,     true,    minuteOfDay("7:15"),       15,         true},
+  {"south_fence",     5,     true,    minuteOfDay("7:30"),        5,        false},
+  {"hill",            4,     true,    minuteOfDay("7:45"),       15,        false},
+  {"back_pots",       3,     true,    minuteOfDay("8:15"),       10,        false},
+  {"back_fence",      2,     true,    minuteOfDay("8:30"),       15,        false},
+  {"north_fence",     1,     true,    minuteOfDay("8:45"),       15,         true},
+  {"unused_0",        0,     true,    minuteOfDay("8:30"),        5,         true}
 };
 
 // Number of irrigation zones (calculated automatically)
 #define NUM_IRRIGATION_ZONES (sizeof(IRRIGATION_ZONES) / sizeof(IrrigationZoneConfig))
 
+constexpr bool irrigationZonesValid(size_t i = 0) {
+  return i == NUM_IRRIGATION_ZONES ||
+    (IRRIGATION_ZONES[i].startMinute >= 0 && IRRIGATION_ZONES[i].pin < 16 && irrigationZonesValid(i + 1));
+}
+static_assert(NUM_IRRIGATION_ZONES <= 16, "more irrigation zones than the MCP23X17 has pins");
+static_assert(irrigationZonesValid(), "an irrigation zone has a start time that isn't h:mm, or a pin past 15");
+
+// Every zone in the table, built in static storage before setup() runs
+// instead of one new each. The table is only read by the compiler.
+template <class Zones> struct BasicIrrigationZoneSet;
+
+template <size_t... I>
+struct BasicIrrigationZoneSet<std::index_sequence<I...>> {
+  McpIrrigationRelay zones[sizeof...(I)];
+
+  //constructor
+  explicit BasicIrrigationZoneSet(McpPort* mcp): zones{
+    McpIrrigationRelay(IRRIGATION_ZONES[I].name, IRRIGATION_ZONES[I].pin, IRRIGATION_ZONES[I].backwards,
+                       IRRIGATION_ZONES[I].startMinute, IRRIGATION_ZONES[I].durationMinutes,
+                       IRRIGATION_ZONES[I].everyOtherDay, McpPins(mcp))...
+  } {}
+};
+
+typedef BasicIrrigationZoneSet<std::make_index_sequence<NUM_IRRIGATION_ZONES>> IrrigationZoneSet;
+
 // Initialize all irrigation zones from configuration
 // Parameters:
 //   zones - Vector to store irrigation zone pointers
-//   mcp - Pointer to the MCP23X17 GPIO expander
-void setupIrrigationZones(Vector<IrrigationRelay*>& zones, Adafruit_MCP23X17* mcp) {
-  for (size_t i = 0; i < NUM_IRRIGATION_ZONES; i++) {
-    const IrrigationZoneConfig& config = IRRIGATION_ZONES[i];
-
-    IrrigationRelay* zone = new IrrigationRelay(
-      config.name,
-      config.pin,
-      config.backwards,
-      config.startTime,
-      config.durationMinutes,
-      config.everyOtherDay,
-      mcp
-    );
-
-    zone->setup();
-    zones.push_back(zone);
+//   set - the zones built from IRRIGATION_ZONES
+void setupIrrigationZones(Vector<McpIrrigationRelay*>& zones, IrrigationZoneSet& set) {
+  for (McpIrrigationRelay& zone : set.zones) {
+    zone.setup();
+    zones.push_back(&zone);
   }
 }
 
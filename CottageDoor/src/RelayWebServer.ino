@@ -7,6 +7,11 @@
 
 #include <my_relay.h>
 #include <my_reed.h>
+#include <my_arena.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
@@ -38,9 +43,17 @@ const int DOOR_OPEN = 1;
 const int DOOR_CLOSED = 0;
 
 int debug = 0;
-Relay * lightSwitch = new ScheduleRelay(TX_PIN);
+Relay * lightSwitch = STATIC_NEW(ScheduleRelay, TX_PIN);
 
-ReedSwitch * cottageDoor = new ReedSwitch(GPIO0_PIN);
+ReedSwitch * cottageDoor = STATIC_NEW(ReedSwitch, GPIO0_PIN);
+
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase doorPhase("door");
 
 void setup() {
   Serial.begin(115200);
@@ -81,7 +94,26 @@ void setup() {
   server.on("/status", handleStatus);
   server.on("/relay", handleRelay);
   server.on("/door", handleDoor);
+  server.on("/metrics", handleMetrics);
   server.begin();
+
+  setupMetrics();
+}
+
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&doorPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
 }
 
 void handleDebug() {
@@ -161,10 +193,19 @@ void handleDoor() {
 }
 
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   if ( cottageDoor->handle() ) {
     syslog.logf(LOG_INFO, "%s %s", cottageDoor->name, cottageDoor->state());
   }
+  loopTimer.lap(doorPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
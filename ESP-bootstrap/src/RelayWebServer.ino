@@ -15,7 +15,6 @@
 #include <WiFiUdp.h>
 #include <Syslog.h>
 #include <ArduinoOTA.h>
-#include <ArduinoJson.h>
 
 #include <time.h>                       // time() ctime()
 
@@ -30,13 +29,17 @@ ESP8266WebServer server(80);
 
 // Syslog server connection info
 #define APP_NAME "bootstrap"
-#define JSON_SIZE 200
 
 // A UDP instance to let us send and receive packets over UDP
 WiFiUDP udpClient;
 
 #include <SPI.h>
 #include <Wire.h>
+#include <my_i2cbus.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
 
 // Create a new syslog instance with LOG_LOCAL0 facility
 Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, APP_NAME, LOG_LOCAL0);
@@ -53,12 +56,20 @@ const int SCL_PIN=22;
 #endif
 
 int debug = 0;
-bool scanI2CMode = false;
+I2CBus i2cBus;
 char msg[40];
 
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase i2cPhase("i2c");
+
 void setup() {
   // set I2C pins (SDA, CLK)
-  Wire.begin(SDA_PIN, SCL_PIN);
+  bool i2cIdle = i2cBus.begin(SDA_PIN, SCL_PIN);
 
   Serial.begin(115200);
   Serial.println("Booting up");
@@ -78,6 +89,9 @@ void setup() {
   sprintf(msg, "Alive! at IP: %s", (char*) WiFi.localIP().toString().c_str());
   Serial.println(msg);
   syslog.logf(LOG_INFO, msg);
+  if (!i2cIdle) {
+    syslog.log(LOG_ERR, "ERROR: I2C bus stuck at boot");
+  }
 
   // Setup OTA Update
   ArduinoOTA.begin();
@@ -93,7 +107,26 @@ void setup() {
   server.on("/debug", handleDebug);
   server.on("/status", handleStatus);
   server.on("/scani2c", handleScanI2C);
+  server.on("/metrics", handleMetrics);
   server.begin();
+
+  setupMetrics();
+}
+
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&i2cPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
 }
 
 void handleDebug() {
@@ -118,91 +151,101 @@ void handleDebug() {
   }
 }
 
+// bus health: the clock, recoveries and every address seen with its
+// transaction count, errors and latency. state=on starts a new scan, which
+// the loop runs a few addresses at a time, and state=off stops it.
 void handleScanI2C() {
   if (server.arg("state") == "on") {
-    server.send(200, "text/plain");
-    scanI2CMode = true;
-    syslog.log(LOG_INFO, "Turned on I2C Scanning");
+    i2cBus.scan();
+    syslog.log(LOG_INFO, "Started I2C Scan");
   } else if (server.arg("state") == "off") {
-    server.send(200, "text/plain");
-    scanI2CMode = false;
-    syslog.log(LOG_INFO, "Turned off I2C Scanning");
-  } else {
+    i2cBus.stopScan();
+    syslog.log(LOG_INFO, "Stopped I2C Scan");
+  } else if (server.arg("state") != "" && server.arg("state") != "status") {
     server.send(404, "text/plain", "ERROR: unknown scani2c command");
+    return;
   }
+
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, "application/json");
+  JsonStream json(response);
+  json.beginObject();
+  json.add("clock", i2cBus.clock);
+  json.add("idle", i2cBus.lineIdle());
+  json.add("recoveries", i2cBus.recoveries);
+  json.add("scanning", i2cBus.scanning());
+  json.add("scans", i2cBus.scans);
+  json.add("found", i2cBus.scanFound);
+
+  json.beginObject("devices");
+  for (uint8_t i = 0; i < i2cBus.deviceCount; i++) {
+    const I2CBus::Device& d = i2cBus.device(i);
+    char hexaddr[5];
+    sprintf(hexaddr, "0x%02x", d.address);
+    json.beginObject(hexaddr);
+    json.add("present", d.present);
+    json.add("ops", d.ops);
+    json.add("errors", d.errors);
+    json.add("avg_us", d.ops ? d.totalMicros / d.ops : 0);
+    json.add("max_us", d.maxMicros);
+    json.endObject();
+  }
+  json.endObject();
+
+  json.endObject();
+  response.end();
 }
 
 void handleStatus() {
   time_t now;
   now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
 
-  doc["i2cScan"] = scanI2CMode;
-  doc["debug"] = debug;
+  json.add("i2cScan", i2cBus.scanning());
+  json.add("debug", debug);
 
   char timeString[20];
   struct tm *timeinfo = localtime(&now);
   strftime (timeString,20,"%D %T",timeinfo);
-  doc["time"] = timeString;
+  json.add("time", timeString);
 
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
-  } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(500, "text/plain", httpResponse);
-  }
+  json.endObject();
+  response.end();
 }
 
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
-  time_t now = time(nullptr);
-  if ( scanI2CMode ) {
-    scanI2C();
-    scanI2CMode = false;
+  // a scan only probes a few addresses per pass
+  bool wasScanning = i2cBus.scanning();
+  i2cBus.handle();
+  if ( wasScanning && !i2cBus.scanning() ) {
+    logI2CScan();
   }
+  loopTimer.lap(i2cPhase);
 
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
-void scanI2C() {
-  byte error, address;
-  int nDevices;
-
-  syslog.logf(LOG_INFO, "Starting I2C Scan"); 
-
-  nDevices = 0;
-  for(address = 0; address <= 127; address++ ) 
-  {
-    // The i2c_scanner uses the return value of
-    // the Write.endTransmisstion to see if
-    // a device did acknowledge to the address.
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-
-    if (error == 0)
-    {
-      char hexaddr[10];
-      sprintf(hexaddr, "0x%02x", address);
-      syslog.logf(LOG_INFO, "I2C device found at address %s", hexaddr);
-
-      nDevices++;
-    }
-    else if (error==4) 
-    {
-      char hexaddr[10];
-      sprintf(hexaddr, "0x%02x", address);
-      syslog.logf(LOG_INFO, "Unknown error at address %s", hexaddr);
-    }    
+void logI2CScan() {
+  for (uint8_t i = 0; i < i2cBus.deviceCount; i++) {
+    const I2CBus::Device& d = i2cBus.device(i);
+    if (!d.present) continue;
+    syslog.logf(LOG_INFO, "I2C device found at address 0x%02x", d.address);
   }
 
-  if (nDevices == 0)
+  if (i2cBus.scanFound == 0)
     syslog.log(LOG_INFO, "No I2C devices found\n");
   else
     syslog.log(LOG_INFO, "I2C scan done\n");
-
 }
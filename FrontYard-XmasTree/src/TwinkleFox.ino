@@ -10,8 +10,9 @@
 
 #include <my_ntp.h>
 #include <teensy_relay.h>
+#include <my_looptimer.h>
 
-#define JSON_SIZE 400
+#define JSON_SIZE 700
 #define NUM_LEDS_PER_STRIP 300
 #define NUM_STRIPS 1
 #define NUM_LEDS      NUM_LEDS_PER_STRIP * NUM_STRIPS
@@ -21,6 +22,10 @@
 int debug = 0;
 teensyRelay * XmasTree = new teensyRelay(22);
 
+LoopTimer loopTimer;
+LoopPhase httpPhase("http");
+LoopPhase ledPhase("leds");
+
 WiFiServer server(80);
 WiFiUdpSender udpClient;
 WiFiUDP Udp;
@@ -163,13 +168,24 @@ void handleStatus(WiFiClient& client) {
   JsonObject sensors = doc.createNestedObject("sensors");
 
   switches[XmasTree->name]["state"] = XmasTree->state();
-  switches[XmasTree->name]["Last On Time"] = XmasTree->prettyOnTime;
-  switches[XmasTree->name]["Last Off Time"] = XmasTree->prettyOffTime;
+  char buf[PRETTY_TIME_SIZE];
+  switches[XmasTree->name]["Last On Time"] = XmasTree->prettyOnTime(buf);
+  switches[XmasTree->name]["Last Off Time"] = XmasTree->prettyOffTime(buf);
   int lightLevel = 0;
   lightLevel = analogRead(A9);
   sensors["lightLevel"] = lightLevel;
   doc["debug"] = debug;
 
+  // where loop() spends its time, in microseconds
+  JsonObject timing = doc.createNestedObject("timing");
+  timing["loop p99"] = (unsigned long) loopTimer.loops.quantile(0.99);
+  timing["loop max"] = (unsigned long) loopTimer.loops.maxValue;
+  timing["http p99"] = (unsigned long) httpPhase.quantile(0.99);
+  timing["http max"] = (unsigned long) httpPhase.maxValue;
+  timing["leds p99"] = (unsigned long) ledPhase.quantile(0.99);
+  timing["leds max"] = (unsigned long) ledPhase.maxValue;
+  timing["stalls"] = loopTimer.stalls;
+
   // 11/16/21 20:17:07
   char timeString[20];
   sprintf(timeString, "%02d/%02d/%04d %02d:%02d:%02d", month(), day(), year(), hour(), minute(), second());
@@ -228,6 +244,7 @@ void handleTree(ArduinoHttpServer::StreamHttpRequest<1024>& httpRequest, WiFiCli
 }
 
 void loop() {
+  loopTimer.begin();
   WiFiClient client( server.available() );
 
   if (client.connected()) {
@@ -251,6 +268,7 @@ void loop() {
     }
     client.stop();
   }
+  loopTimer.lap(httpPhase);
 
   if (XmasTree->status()) {
     EVERY_N_SECONDS( SECONDS_PER_PALETTE ) { 
@@ -265,6 +283,12 @@ void loop() {
 
     FastLED.show();
   }
+  loopTimer.lap(ledPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
 //  This function loops over each pixel, calculates the 
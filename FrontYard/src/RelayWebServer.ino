@@ -3,7 +3,6 @@
 #include <WiFiUdp.h>
 #include <Syslog.h>
 #include <ArduinoOTA.h>
-#include <ArduinoJson.h>
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
@@ -20,13 +19,20 @@
 #include <DallasTemperature.h>
 
 #include <my_relay.h>
+#include <my_arena.h>
 #include <my_motion.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_logqueue.h>
+#include <my_router.h>
 
 ESP8266WebServer server(80);
+CommandRouter<ESP8266WebServer> router(server);
 
 // This device info
 #define MYTZ TZ_America_Los_Angeles
-#define JSON_SIZE 1000
 
 // A UDP instance to let us send and receive packets over UDP
 WiFiUDP udpClient;
@@ -37,7 +43,9 @@ WiFiUDP udpClient;
 #define MOTION_APPNAME "motionsensor"
 #define LIGHTSWITCH_APPNAME "lightswitch"
 #define IRRIGATION_APPNAME "irrigation"
-Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+Syslog syslogUdp(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+// messages wait here and go out from the end of loop()
+LogQueue syslog(syslogUdp, SYSTEM_APPNAME);
 // instantiate the display
 Adafruit_SSD1306 display = Adafruit_SSD1306(128 /*width*/, 64 /*height*/, &Wire, -1);
 // Adafruit i2c LUX sensor
@@ -53,19 +61,32 @@ int const ONEWIRE_PIN = D7;
 //DallasTemperature sensors(&ds);
 //DeviceAddress frontyardThermometer;
 
-DuskToDawnScheduleRelay * lvLights = new DuskToDawnScheduleRelay(D4);
-IrrigationRelay * irrigation = new IrrigationRelay(D5);
-MOTION * motionsensor = new MOTION(D6);
+DuskToDawnScheduleRelay * lvLights = STATIC_NEW(DuskToDawnScheduleRelay, D4);
+IrrigationRelay * irrigation = STATIC_NEW(IrrigationRelay, D5);
+MOTION * motionsensor = STATIC_NEW(MOTION, D6);
 
 float temperature = 0;
 bool displayOn = true;
 
+MetricRegistry metrics;
+Counter syslogDropCounter("syslog_dropped_total", "Log messages dropped with the queue full.");
+Counter syslogTruncateCounter("syslog_truncated_total", "Log messages cut short to fit the queue.");
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase relayPhase("relays");
+LoopPhase displayPhase("display");
+LoopPhase syslogPhase("syslog");
+
 void setup() {
   Serial.begin(9600);
   Serial.println("Booting up");
 
   // prepare the motion sensor
   motionsensor->setup("frontyard");
+  motionsensor->useInterrupts();
 
   // Connect to WiFi network
   WiFi.mode(WIFI_STA);
@@ -83,6 +104,8 @@ void setup() {
   syslog.logf(LOG_INFO, msg);
 
   // Setup OTA Update
+  // the update ends in a reboot, send what is still queued first
+  ArduinoOTA.onStart([]() { syslog.flush(); });
   ArduinoOTA.begin();
  
   // set the time
@@ -112,8 +135,11 @@ void setup() {
   server.on("/irrigation", handleIrrigation);
   server.on("/status", handleStatus);
   server.on("/sensors", handleSensors);
+  server.on("/metrics", handleMetrics);
   server.begin();
 
+  setupMetrics();
+
   // set I2C pins (SDA, SDL)
   Wire.begin(D2, D1);
 
@@ -129,8 +155,6 @@ void setup() {
   // Clear the buffer
   display.clearDisplay();
 
-  syslog.appName(LIGHT_APPNAME);
-
 /*
   // Start up the DallasTemperature library
   syslog.appName(THERMO_APPNAME);
@@ -145,83 +169,83 @@ void setup() {
 }
 
 void handleDebug() {
-  if (server.arg("level") == "0") {
-    syslog.log(LOG_INFO, "Debug level 0");
-    debug = 0;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "1") {
-    syslog.log(LOG_INFO, "Debug level 1");
-    debug = 1;
-    server.send(200, "text/plain");
-  } if (server.arg("level") == "2") {
-    syslog.log(LOG_INFO, "Debug level 2");
-    debug = 2;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "status") {
-    char msg[40];
-    sprintf(msg, "Debug level: %d", debug);
-    server.send(200, "text/plain", msg);
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown debug command");
-  }
+  router.dispatchDebug(debug, syslog);
 }
 
-void handleLight() {
-  if (server.arg("state") == "on") {
+// /light and /irrigation take the same commands, each for its own relay
+enum SwitchArg : uint8_t { ARG_STATE, ARG_OVERRIDE };
+const RouteParam SWITCH_PARAMS[] = {
+  { "state", ROUTE_TABLE(SWITCH_CHOICES) },
+  { "override", ROUTE_TABLE(SWITCH_CHOICES) },
+};
+
+void sendSwitchState(RouteArgs& args) {
+  RelayBase * relay = static_cast<RelayBase*>(args.context);
+  server.send(200, "text/plain", relay->status() ? "1" : "0");
+}
+
+void setOverride(RouteArgs& args) {
+  RelayBase * relay = static_cast<RelayBase*>(args.context);
+  bool override = args.choice(ARG_OVERRIDE) == SWITCH_ON;
+  syslog.logf(LOG_INFO, "%s %s schedule", override ? "Disabling" : "Enabling", relay->name);
+  relay->setScheduleOverride(override);
+  server.send(200, "text/plain");
+}
+
+void sendOverride(RouteArgs& args) {
+  RelayBase * relay = static_cast<RelayBase*>(args.context);
+  server.send(200, "text/plain", relay->scheduleOverride ? "1" : "0");
+}
+
+void switchLight(RouteArgs& args) {
+  if (args.choice(ARG_STATE) == SWITCH_ON) {
     lvLights->switchOn();
-    syslog.logf(LOG_INFO, "Turned %s on by API request", lvLights->name);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "off") {
-    lvLights->switchOff();
-    syslog.logf(LOG_INFO, "Turned %s off by API request", lvLights->name);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "status") {
-    server.send(200, "text/plain", lvLights->on ? "1" : "0");
-  } else if (server.arg("override") == "on") {
-    syslog.log(LOG_INFO, "Disabling light schedule");
-    lvLights->setScheduleOverride(true);
-    server.send(200, "text/plain");
-  } else if (server.arg("override") == "off") {
-    syslog.log(LOG_INFO, "Enabling light schedule");
-    lvLights->setScheduleOverride(false);
-    server.send(200, "text/plain");
-  } else if (server.arg("override") == "status") {
-    server.send(200, "text/plain", lvLights->scheduleOverride ? "1" : "0");
   } else {
-    server.send(404, "text/plain", "ERROR: unknown light command");
+    lvLights->switchOff();
   }
+  syslog.logf(LOG_INFO, "Turned %s %s by API request", lvLights->name, lvLights->state());
+  server.send(200, "text/plain");
 }
 
-void handleIrrigation() {
-  if (server.arg("state") == "on") {
+void switchIrrigation(RouteArgs& args) {
+  if (args.choice(ARG_STATE) == SWITCH_ON) {
     syslog.logf(LOG_INFO, "Turned irrigation %s on for %ds", irrigation->name, irrigation->runTime);
     irrigation->switchOn();
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "off") {
+  } else {
     irrigation->switchOff();
     syslog.logf(LOG_INFO, "Turned irrigation %s off", irrigation->name);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "status") {
-    server.send(200, "text/plain", irrigation->status() ? "1" : "0");
-  } else if (server.arg("override") == "on") {
-    syslog.log(LOG_INFO, "Disabling irrigation schedule");
-    irrigation->setScheduleOverride(true);
-    server.send(200, "text/plain");
-  } else if (server.arg("override") == "off") {
-    syslog.log(LOG_INFO, "Enabling irrigation schedule");
-    irrigation->setScheduleOverride(false);
-    server.send(200, "text/plain");
-  } else if (server.arg("override") == "status") {
-    server.send(200, "text/plain", irrigation->scheduleOverride ? "1" : "0");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown irrigation command");
   }
+  server.send(200, "text/plain");
+}
+
+const RouteCommand LIGHT_COMMANDS[] = {
+  { ARG_STATE, SWITCH_STATUS, sendSwitchState },
+  { ARG_STATE, ROUTE_ANY, switchLight },
+  { ARG_OVERRIDE, SWITCH_STATUS, sendOverride },
+  { ARG_OVERRIDE, ROUTE_ANY, setOverride },
+};
+const Route LIGHT_ROUTE = { ROUTE_TABLE(SWITCH_PARAMS), ROUTE_TABLE(LIGHT_COMMANDS), "ERROR: unknown light command" };
+
+const RouteCommand IRRIGATION_COMMANDS[] = {
+  { ARG_STATE, SWITCH_STATUS, sendSwitchState },
+  { ARG_STATE, ROUTE_ANY, switchIrrigation },
+  { ARG_OVERRIDE, SWITCH_STATUS, sendOverride },
+  { ARG_OVERRIDE, ROUTE_ANY, setOverride },
+};
+const Route IRRIGATION_ROUTE = { ROUTE_TABLE(SWITCH_PARAMS), ROUTE_TABLE(IRRIGATION_COMMANDS), "ERROR: unknown irrigation command" };
+
+void handleLight() {
+  router.dispatch(LIGHT_ROUTE, lvLights);
+}
+
+void handleIrrigation() {
+  router.dispatch(IRRIGATION_ROUTE, irrigation);
 }
 
 void handleSensors() {
   if (server.arg("sensor") == "moisture") {
     char msg[10];
-    sprintf(msg, "%0.2f", irrigation->moisturePercentage);
+    sprintf(msg, "%d", irrigation->moisturePercentage);
     server.send(200, "text/plain", msg);
   } else if (server.arg("sensor") == "light") {
     char msg[10];
@@ -239,77 +263,108 @@ void handleSensors() {
 void handleStatus() {
   time_t now;
   now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
-
-  JsonObject switches = doc.createNestedObject("switches");
-  switches["irrigation"]["state"] = irrigation->state();
-  switches["irrigation"]["override"] = irrigation->scheduleOverride;
-  switches["irrigation"]["Time Left"] = irrigation->timeLeftToRun;
-  switches["irrigation"]["Last Run Time"] = irrigation->prettyOnTime;
-  switches["irrigation"]["Next Run Time"] = irrigation->nextTimeToRun;
-  switches["lvLights"]["state"] = lvLights->state();
-  switches["lvLights"]["override"] = lvLights->scheduleOverride;
-
-  JsonObject sensors = doc.createNestedObject("sensors");
-  sensors["temperature"] = temperature;
-  sensors["lightLevel"] = lvLights->lightLevel;
-  sensors["moistureLevel"] = irrigation->moistureLevel;
-  sensors["moisturePercentage"] = irrigation->moisturePercentage;
-  sensors[motionsensor->name]["state"] = motionsensor->activity();
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+
+  json.beginObject("switches");
+  json.beginObject("irrigation");
+  json.add("state", irrigation->state());
+  json.add("override", irrigation->scheduleOverride);
+  char buf[PRETTY_TIME_SIZE];
+  json.add("Time Left", irrigation->timeLeftToRun(buf));
+  json.add("Last Run Time", irrigation->prettyOnTime(buf));
+  json.add("Next Run Time", irrigation->nextTimeToRun(buf));
+  json.endObject();
+  json.beginObject("lvLights");
+  json.add("state", lvLights->state());
+  json.add("override", lvLights->scheduleOverride);
+  json.endObject();
+  json.endObject();
+
+  json.beginObject("sensors");
+  json.add("temperature", temperature);
+  json.add("lightLevel", lvLights->lightLevel);
+  json.add("moistureLevel", irrigation->moistureLevel);
+  json.add("moisturePercentage", irrigation->moisturePercentage);
+  json.beginObject(motionsensor->name);
+  json.add("state", motionsensor->activity());
+  json.endObject();
+  json.endObject();
+
   char timeString[20];
   struct tm *timeinfo = localtime(&now);
   strftime (timeString,20,"%D %T",timeinfo);
-  doc["time"] = timeString;
-  doc["debug"] = debug;
-  doc["displayOn"] = displayOn;
-
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
-  } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(500, "text/plain", httpResponse);
-  }
+  json.add("time", timeString);
+  json.add("debug", debug);
+  json.add("displayOn", displayOn);
+
+  json.endObject();
+  response.end();
 }
 
 time_t prevTime = 0;
 time_t now = 0;
+void setupMetrics() {
+  syslogDropCounter.setSource([](void*) { return (double) syslog.dropped; });
+  metrics.add(&syslogDropCounter);
+  syslogTruncateCounter.setSource([](void*) { return (double) syslog.truncated; });
+  metrics.add(&syslogTruncateCounter);
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&relayPhase);
+  loopTimer.add(&displayPhase);
+  loopTimer.add(&syslogPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
+
+  // both relays decide on the same instant
+  ClockSnapshot clock = clockSnapshot();
 
-  syslog.appName(IRRIGATION_APPNAME);
   if ( now != prevTime && debug >= 2 )  {
-    syslog.log(LOG_INFO, "DEBUG: Enabled");
+    syslog.log(IRRIGATION_APPNAME, LOG_INFO, "DEBUG: Enabled");
 
     String timesToStart = "DEBUG: times to start: ";
     irrigation->checkStartTime(timesToStart);
-    syslog.log(LOG_INFO, timesToStart);
+    syslog.log(IRRIGATION_APPNAME, LOG_INFO, timesToStart);
     
     if ( irrigation->checkDayToRun() ) {
-      syslog.log(LOG_INFO, "DEBUG: Enabled for today");
+      syslog.log(IRRIGATION_APPNAME, LOG_INFO, "DEBUG: Enabled for today");
     }
     if ( irrigation->isTimeToStart() ) {
-      syslog.log(LOG_INFO, "DEBUG: it's time to start");
+      syslog.log(IRRIGATION_APPNAME, LOG_INFO, "DEBUG: it's time to start");
     }
   }
 
   if ( now != prevTime )  {
     String reason;
-    if ( irrigation->handle() ) {
-      syslog.logf(LOG_INFO, "%s %s; Moisture: %f%%", irrigation->name, irrigation->state(), irrigation->moisturePercentage);
+    if ( irrigation->handle(clock) ) {
+      syslog.logf(IRRIGATION_APPNAME, LOG_INFO, "%s %s; Moisture: %d%%", irrigation->name, irrigation->state(), irrigation->moisturePercentage);
     } 
   }
 
-  syslog.appName(LIGHTSWITCH_APPNAME);
-  if (lvLights->handle()) {
-    syslog.logf(LOG_INFO, "Turned %s %s", lvLights->name, lvLights->state());
+  if (lvLights->handle(clock)) {
+    syslog.logf(LIGHTSWITCH_APPNAME, LOG_INFO, "Turned %s %s", lvLights->name, lvLights->state());
   }
+  loopTimer.lap(relayPhase);
 
-  syslog.appName(SYSTEM_APPNAME);
   prevTime = now;
   now = time(nullptr);
   if ( ( now != prevTime ) && ( now % 5 == 0 ) ) {
@@ -317,19 +372,27 @@ void loop() {
      motionsensor->handle();
      updateDisplay();
   }
+  loopTimer.lap(displayPhase);
+
+  syslog.handle();
+  loopTimer.lap(syslogPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
 void updateDisplay() {
-    syslog.appName(MOTION_APPNAME);
     if (motionsensor->activity() && !displayOn) {            // check if the input is HIGH
       display.ssd1306_command(SSD1306_DISPLAYON);
       displayOn = true;
-      syslog.log(LOG_INFO, "Person detected, turned display on");
+      syslog.log(MOTION_APPNAME, LOG_INFO, "Person detected, turned display on");
     }
     if (!motionsensor->activity() && displayOn) {
       display.ssd1306_command(SSD1306_DISPLAYOFF);
       displayOn = false;
-      syslog.log(LOG_INFO, "Nobody detected, turned display off");
+      syslog.log(MOTION_APPNAME, LOG_INFO, "Nobody detected, turned display off");
     }
 
     if (displayOn) {
@@ -346,7 +409,7 @@ void updateDisplay() {
       display.println(timeString);
       display.printf("Light Level: %d", lvLights->lightLevel);
       display.println();
-      display.printf("Moisture: %0.2f", irrigation->moisturePercentage);
+      display.printf("Moisture: %d", irrigation->moisturePercentage);
       display.println();
       //display.printf("Temperature: %2.2f", temperature);
       //display.println();
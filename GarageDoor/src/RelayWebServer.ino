@@ -5,9 +5,15 @@
 #include <WiFiUdp.h>
 #include <Syslog.h>
 #include <ArduinoOTA.h>
-#include <ArduinoJson.h>
 
 #include <my_relay.h>
+#include <my_arena.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_journal.h>
+#include <my_router.h>
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
@@ -16,10 +22,10 @@
 
 // This device info
 #define APP_NAME "garagedoor"
-#define JSON_SIZE 500
 #define MYTZ TZ_America_Los_Angeles
 
 ESP8266WebServer server(80);
+CommandRouter<ESP8266WebServer> router(server);
 
 // A UDP instance to let us send and receive packets over UDP
 WiFiUDP udpClient;
@@ -34,7 +40,23 @@ const uint8_t REED_OPEN_PIN = D2;
 const uint8_t REED_CLOSED_PIN = D3;
 const uint8_t LED_OPEN_PIN = D6;
 const uint8_t LED_CLOSED_PIN = D5;
-GarageDoorRelay * garageDoor = new GarageDoorRelay(RELAY_PIN, REED_OPEN_PIN, REED_CLOSED_PIN, LED_OPEN_PIN, LED_CLOSED_PIN);
+GarageDoorRelay * garageDoor = STATIC_NEW(GarageDoorRelay, RELAY_PIN, REED_OPEN_PIN, REED_CLOSED_PIN, LED_OPEN_PIN, LED_CLOSED_PIN);
+
+MetricRegistry metrics;
+Gauge doorOpenGauge("garage_door_open", "1 while the door is all the way open.");
+Counter operationCounter("garage_door_operations_total", "Button presses from the API.");
+// a healthy door takes 12-14s, a slow one shows up in the upper buckets
+const float TRAVEL_BUCKETS[] = { 8, 10, 12, 14, 16, 20, 30 };
+BucketHistogram<7> travelHistogram("garage_door_travel_seconds", "Time from one end to the other.", TRAVEL_BUCKETS);
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase doorPhase("door");
+LoopPhase httpPhase("http");
+
+// the door moving and stopping, for /events
+EventJournal journal;
 
 void setup() {
   Serial.begin(115200);
@@ -57,6 +79,8 @@ void setup() {
   sprintf(msg, "Alive! at IP: %s", (char*) WiFi.localIP().toString().c_str());
   Serial.println(msg);
   syslog.log(LOG_INFO, msg);
+  journal.begin(ESP.random());
+  journal.record(APP_NAME, EVENT_BOOT);
 
   // Setup OTA Update
   ArduinoOTA.begin();
@@ -64,82 +88,136 @@ void setup() {
   configTime(MYTZ, "pool.ntp.org");
 
   garageDoor->setup("garage_door");
+  garageDoor->useInterrupts();
+
+  doorOpenGauge.setSource([](void*) { return (double) (garageDoor->doorState == DOOR_OPEN); });
+  metrics.add(&doorOpenGauge);
+  metrics.add(&operationCounter);
+  metrics.add(&travelHistogram);
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&doorPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.addTo(metrics);
 
   // Start the server
   // Start the server
   server.on("/debug", handleDebug);
   server.on("/status", handleStatus);
   server.on("/door", handleDoor);
+  server.on("/metrics", handleMetrics);
+  server.on("/events", handleEvents);
   server.begin();
 }
 
 void handleDebug() {
-  if (server.arg("level") == "status") {
-    char msg[40];
-    sprintf(msg, "Debug level: %d", debug);
-    server.send(200, "text/plain", msg);
-  } else if (server.arg("level") == "0") {
-    syslog.log(LOG_INFO, "Debug level 0");
-    debug = 0;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "1") {
-    syslog.log(LOG_INFO, "Debug level 1");
-    debug = 1;
-    server.send(200, "text/plain");
-  } if (server.arg("level") == "2") {
-    syslog.log(LOG_INFO, "Debug level 2");
-    debug = 2;
-    server.send(200, "text/plain");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown debug command");
-  }
+  router.dispatchDebug(debug, syslog);
 }
 
 void handleStatus() {
   time_t now;
   now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
-
-  JsonObject switches = doc.createNestedObject("switches");
-  switches[garageDoor->name]["state"] = garageDoor->state();
-
-  doc["debug"] = debug;
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+
+  json.beginObject("switches");
+  json.beginObject(garageDoor->name);
+  json.add("state", garageDoor->state());
+  char buf[PRETTY_TIME_SIZE];
+  json.add("Last Change", formatTime(garageDoor->lastChangeTime, buf));
+  json.add("Travel Time (ms)", garageDoor->lastTravelMillis);
+  json.endObject();
+  json.endObject();
+
+  json.add("debug", debug);
 
   char timeString[20];
   struct tm *timeinfo = localtime(&now);
   strftime (timeString,20,"%D %T",timeinfo);
-  doc["time"] = timeString;
+  json.add("time", timeString);
 
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
-  } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(500, "text/plain", httpResponse);
-  }
+  json.endObject();
+  response.end();
 }
 
-void handleDoor() {
-  if (server.arg("command") == "status") {
-    server.send(200, "text/plain", garageDoor->state());
-  } else if (server.arg("command") == "operate") {
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
+// the events after ?since=, oldest first; poll again with the last seq seen
+void handleEvents() {
+  uint32_t since = strtoul(server.arg("since").c_str(), nullptr, 10);
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response, false);
+  json.beginObject();
+  journal.writeJson(json, since);
+  json.endObject();
+  response.end();
+}
+
+enum DoorCommand : int8_t { DOOR_STATUS, DOOR_OPERATE };
+const char* const DOOR_CHOICES[] = { "status", "operate" };
+const RouteParam DOOR_PARAMS[] = { { "command", ROUTE_TABLE(DOOR_CHOICES) } };
+
+void sendDoorState(RouteArgs&) {
+  server.send(200, "text/plain", garageDoor->state());
+}
+
+void operateDoor(RouteArgs&) {
+  // the loop releases the button, so this returns straight away
+  if (garageDoor->operate()) {
+    operationCounter.inc();
     syslog.log(LOG_INFO, "Operating Garage Door");
-    garageDoor->operate();
     server.send(200, "text/plain");
   } else {
-    server.send(404, "text/plain", "ERROR: uknonwn light command");
+    server.send(409, "text/plain", "ERROR: garage door button already pressed");
   }
 }
 
+const RouteCommand DOOR_COMMANDS[] = {
+  { 0, DOOR_STATUS, sendDoorState },
+  { 0, DOOR_OPERATE, operateDoor },
+};
+const Route DOOR_ROUTE = { ROUTE_TABLE(DOOR_PARAMS), ROUTE_TABLE(DOOR_COMMANDS), "ERROR: unknown door command" };
+
+void handleDoor() {
+  router.dispatch(DOOR_ROUTE);
+}
+
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
 
   if (garageDoor->handle()) {
-    syslog.logf(LOG_INFO, "Garage door %s", garageDoor->state());
+    if (garageDoor->doorState == DOOR_OPEN || garageDoor->doorState == DOOR_CLOSED) {
+      syslog.logf(LOG_INFO, "Garage door %s after %lums", garageDoor->state(), garageDoor->lastTravelMillis);
+      // nothing was timed when the door settles at boot
+      if (garageDoor->lastTravelMillis > 0) travelHistogram.observe(garageDoor->lastTravelMillis / 1000.0);
+      // the travel time in ms, up to the 32s a record holds
+      journal.record(garageDoor->name, garageDoor->doorState == DOOR_OPEN ? EVENT_OPEN : EVENT_CLOSED,
+                     garageDoor->lastTravelMillis < 32767 ? garageDoor->lastTravelMillis : 32767);
+    } else {
+      syslog.logf(LOG_INFO, "Garage door %s", garageDoor->state());
+      if (garageDoor->doorState == DOOR_OPENING) journal.record(garageDoor->name, EVENT_OPENING);
+      if (garageDoor->doorState == DOOR_CLOSING) journal.record(garageDoor->name, EVENT_CLOSING);
+    }
   }
+  loopTimer.lap(doorPhase);
 
   server.handleClient();
+  loopTimer.lap(httpPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #define DEBUG 0
-#define JSON_SIZE 600
 #define MYTZ TZ_America_Los_Angeles
 #define HTTP_METRICS_ENDPOINT "/metrics"
 // Board name
@@ -24,5 +23,10 @@
   #define GPIO0_PIN 0
   #define GPIO2_PIN 2
   #define REED_PIN 15
+  #define MCP_ADDRESS 0x20
+  #define VEML_ADDRESS 0x10
+  // the MCP23017 INTA/INTB line, if it is wired to the ESP; the shed door
+  // is polled once a second without it
+  //#define MCP_INT_PIN RX_PIN
 #endif
 
@@ -15,6 +15,15 @@
 #include <TZ.h>
 
 #include <my_relay.h>
+#include <my_scheduler.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_logqueue.h>
+#include <my_journal.h>
+#include <my_router.h>
+#include <my_arena.h>
 
 #include "config_default.h"
 
@@ -32,9 +41,9 @@ Adafruit_SSD1306 display = Adafruit_SSD1306(128 /*width*/, 64 /*height*/, &Wire,
 OneWire ds(ONEWIRE_PIN);  // on pin D7 (a 4.7K resistor is necessary)
 DallasTemperature sensors(&ds);
 DeviceAddress frontyardThermometer;
-DuskToDawnScheduleRelay * lvLights = new DuskToDawnScheduleRelay(D4);
-IrrigationRelay * irrigation = new IrrigationRelay(D5);
-MOTION * motionsensor = new MOTION(D6);
+DuskToDawnScheduleRelay * lvLights = STATIC_NEW(DuskToDawnScheduleRelay, D4);
+IrrigationRelay * irrigation = STATIC_NEW(IrrigationRelay, D5);
+MOTION * motionsensor = STATIC_NEW(MOTION, D6);
 float temperature = 0;
 bool displayOn = true;
 
@@ -42,52 +51,67 @@ bool displayOn = true;
 #include "Adafruit_MCP23X17.h"
 #include <my_veml.h>
 #include <my_reed.h>
+#include <my_i2cbus.h>
 Veml veml;
+I2CBus i2cBus;
 Adafruit_MCP23X17 mcp;
-ReedSwitch * shedDoor = new ReedSwitch(REED_PIN, &mcp);
+McpPort mcpPort(&mcp);
+McpInterrupts mcpInterrupts;
+ReedSwitch * shedDoor = STATIC_NEW(ReedSwitch, REED_PIN, &mcpPort);
 #endif
 
 ESP8266WebServer server(80);
+CommandRouter<ESP8266WebServer> router(server);
 
 // A UDP instance to let us send and receive packets over UDP
 WiFiUDP udpClient;
 
 // Create a new syslog instance with LOG_LOCAL0 facility
-Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+Syslog syslogUdp(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+// messages wait here and go out from the end of loop()
+LogQueue syslog(syslogUdp, SYSTEM_APPNAME);
 
 int debug = DEBUG;
 StaticJsonDocument<200> doc;
-Vector<IrrigationRelay*> IrrigationZones;
-IrrigationRelay * storage_array[8];
+#define MAX_IRRIGATION_ZONES 8
+// longest loop() will sleep waiting for a relay, keeps HTTP and OTA responsive
+#define MAX_IDLE_MS 2
+Vector<McpIrrigationRelay*> IrrigationZones;
+McpIrrigationRelay * storage_array[MAX_IRRIGATION_ZONES];
+RelayScheduler scheduler;
+RelayScheduler::Entry scheduler_storage[MAX_IRRIGATION_ZONES];
+
+MetricRegistry metrics;
+Gauge zoneOnGauges[MAX_IRRIGATION_ZONES];
+Gauge zoneMoistureGauges[MAX_IRRIGATION_ZONES];
+Counter zoneRunCounters[MAX_IRRIGATION_ZONES];
+Counter syslogDropCounter("syslog_dropped_total", "Log messages dropped with the queue full.");
+Counter syslogTruncateCounter("syslog_truncated_total", "Log messages cut short to fit the queue.");
+HeapMetrics heapMetrics;
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase sensorPhase("sensors");
+LoopPhase relayPhase("relays");
+LoopPhase syslogPhase("syslog");
+// switches, doors and sensor alarms, for /events
+EventJournal journal;
+#ifdef LOCATION_BACKYARD
+Gauge lightGauge("irrigation_light_lux", "Ambient light.");
+Gauge doorGauge("irrigation_shed_door_open", "1 while the shed door is open.");
+Counter i2cRecoveryCounter("irrigation_i2c_recoveries_total", "Times the I2C bus was unstuck.");
+#endif
 
 
 void handleDebug() {
-  if (server.arg("level") == "status") {
-    char msg[40];
-    sprintf(msg, "Debug level: %d", debug);
-    server.send(200, "text/plain",msg);
-  } else if (server.arg("level") == "0") {
-    syslog.log(LOG_INFO, "Debug level 0");
-    debug = 0;
-    server.send(200, "text/plain");
-  } else if (server.arg("level") == "1") {
-    syslog.log(LOG_INFO, "Debug level 1");
-    debug = 1;
-    server.send(200, "text/plain");
-  } if (server.arg("level") == "2") {
-    syslog.log(LOG_INFO, "Debug level 2");
-    debug = 2;
-    server.send(200, "text/plain");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown debug command");
-  }
+  router.dispatchDebug(debug, syslog);
 }
 
 void handleZones() {
   String zones;
 
   bool first = true;
-  for (IrrigationRelay * relay : IrrigationZones) {
+  for (McpIrrigationRelay * relay : IrrigationZones) {
     if ( first ) {
       zones = relay->name;
       first = false;
@@ -110,7 +134,7 @@ void handleDoor() {
 void handleSensors() {
   if (server.arg("sensor") == "light") {
     char msg[10];
-    sprintf(msg, "%d", veml.readLux());
+    sprintf(msg, "%d", veml.lux);
     server.send(200, "text/plain", msg);
   } 
     else if (server.arg("sensor") == "door") {
@@ -122,109 +146,229 @@ void handleSensors() {
 void handleStatus() {
   time_t now;
   now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
   char suppliedZone[15];
   server.arg("zone").toCharArray(suppliedZone, 15);
-  bool matchFound = false;
 
-  JsonObject switches = doc.createNestedObject("switches");
-  JsonObject sensors = doc.createNestedObject("sensors");
-  for (IrrigationRelay * relay : IrrigationZones) {
+  McpIrrigationRelay * match = nullptr;
+  for (McpIrrigationRelay * relay : IrrigationZones) {
     if (server.arg("zone") == relay->name) {
-      matchFound = true;
-      switches[relay->name]["State"] = relay->state();
-      switches[relay->name]["Override"] = relay->scheduleOverride;
-      switches[relay->name]["Moisture Level"] = relay->moistureLevel;
-      switches[relay->name]["Moisture Percentage"] = relay->moisturePercentage;
-      switches[relay->name]["Time Left"] = relay->timeLeftToRun;
-      switches[relay->name]["Last Run Time"] = relay->prettyOnTime;
-      switches[relay->name]["Next Run Time"] = relay->nextTimeToRun;
-      char weekSchedule[8];
-      relay->getWeekSchedule(weekSchedule);
-      switches[relay->name]["Week Schedule"] = weekSchedule;
+      match = relay;
+      break;
     }
   } 
 
-  if (!matchFound) {
+  if (!match) {
     char msg[60];
     sprintf(msg, "ERROR: irrigation zone %s not found", suppliedZone);
     server.send(404, "text/plain", msg);
     return;
   }
 
+  // the headers go out now and the body a chunk at a time as it is written
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+
+  json.beginObject("switches");
+  json.beginObject(match->name);
+  json.add("State", match->state());
+  json.add("Override", match->scheduleOverride);
+  json.add("Moisture Level", match->moistureLevel);
+  json.add("Moisture Percentage", match->moisturePercentage);
+  char buf[PRETTY_TIME_SIZE];
+  json.add("Time Left", match->timeLeftToRun(buf));
+  json.add("Last Run Time", match->prettyOnTime(buf));
+  json.add("Next Run Time", match->nextTimeToRun(buf));
+  char weekSchedule[8];
+  match->getWeekSchedule(weekSchedule);
+  json.add("Week Schedule", weekSchedule);
+  json.endObject();
+  json.endObject();
+
+  json.beginObject("sensors");
 #ifdef LOCATION_BACKYARD
-  sensors["Door Status"] = shedDoor->state();
-  sensors["Light Level"] = veml.readLux();
-  doc["debug"] = debug;
+  json.add("Door Status", shedDoor->state());
+  json.add("Light Level", veml.lux);
+  json.add("Light Age (ms)", veml.sampleAge());
+#endif
+  json.endObject();
+#ifdef LOCATION_BACKYARD
+  json.add("debug", debug);
 #endif
 
   char timeString[20];
   struct tm *timeinfo = localtime(&now);
   strftime (timeString,20,"%D %T",timeinfo);
-  doc["time"] = timeString;
+  json.add("time", timeString);
 
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
-  } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(500, "text/plain", httpResponse);
+  json.endObject();
+  response.end();
+}
+
+McpIrrigationRelay* findZoneByName(const char* zoneName) {
+  for (McpIrrigationRelay* relay : IrrigationZones) {
+    if (strcmp(zoneName, relay->name) == 0) return relay;
   }
+  return nullptr;
 }
 
-void handleIrrigation() {
-  bool matchFound = false;
-  char suppliedZone[15];
-  server.arg("zone").toCharArray(suppliedZone, 15);
+enum IrrigationArg : uint8_t { ARG_ZONE, ARG_STATE, ARG_OVERRIDE };
+enum OverrideChoice : int8_t { OVERRIDE_TRUE, OVERRIDE_FALSE };
+const char* const OVERRIDE_CHOICES[] = { "true", "false" };
+const RouteParam IRRIGATION_PARAMS[] = {
+  { "zone", nullptr, 0 },
+  { "state", ROUTE_TABLE(SWITCH_CHOICES) },
+  { "override", ROUTE_TABLE(OVERRIDE_CHOICES) },
+};
+
+void setZoneOverride(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  bool override = args.choice(ARG_OVERRIDE) == OVERRIDE_TRUE;
+  relay->setScheduleOverride(override);
+  syslog.logf(LOG_INFO, "Schedule %s for irrigation zone %s by API request", override ? "disabled" : "enabled", relay->name);
+  server.send(200, "text/plain");
+}
 
-  for (IrrigationRelay * relay : IrrigationZones) {
-    if (debug) {
-      syslog.logf(LOG_INFO, "DEBUG: irrigation handling: zone arg: %s, relay name: %s", suppliedZone, relay->name);
-    }
+// runs started by the schedule or the API, like BackyardShed counts them
+void countZoneRun(McpIrrigationRelay * relay) {
+  for (uint8_t i = 0; i < IrrigationZones.size(); i++) {
+    if (IrrigationZones[i] == relay) zoneRunCounters[i].inc();
+  }
+}
 
-    if (server.arg("zone") == relay->name) {
-      matchFound = true;
-      if (server.arg("override") == "true") {
-	      relay->setScheduleOverride(true);
-	      syslog.logf(LOG_INFO, "Schedule disabled for irrigation zone %s on by API request", relay->name);
-	      server.send(200, "text/plain");
-	      return;
-      } else if (server.arg("override") == "false") {
-	      relay->setScheduleOverride(false);
-	      syslog.logf(LOG_INFO, "Schedule enabled for irrigation zone %s on by API request", relay->name);
-	      server.send(200, "text/plain");
-	      return;
-      } else if (server.arg("state") == "status") {
-	server.send(200, "text/plain", relay->status() ? "1" : "0");
-	return;
-      } else if (server.arg("state") == "on") {
-	      relay->switchOn();
-	      syslog.logf(LOG_INFO, "Turned irrigation zone %s on by API request for %ds", relay->name, relay->runTime);
-	      server.send(200, "text/plain");
-	      return;
-      } else if (server.arg("state") == "off") {
-	      relay->switchOff();
-	      syslog.logf(LOG_INFO, "Turned irrigation zone %s off by API request", relay->name);
-	      server.send(200, "text/plain");
-	      return;
-      } else {
-	      char msg[40];
-	      sprintf(msg, "ERROR: state command not specified for %s", relay->name);
-	      server.send(404, "text/plain", msg);
-      }
-    }
+void switchZone(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  if (args.choice(ARG_STATE) == SWITCH_ON) {
+    relay->switchOn();
+    countZoneRun(relay);
+    syslog.logf(LOG_INFO, "Turned irrigation zone %s on by API request for %ds", relay->name, relay->runTime);
+    journal.record(relay->name, EVENT_ON, relay->runTime);
+  } else {
+    relay->switchOff();
+    syslog.logf(LOG_INFO, "Turned irrigation zone %s off by API request", relay->name);
+    journal.record(relay->name, EVENT_OFF);
   }
-  if (!matchFound) {
+  server.send(200, "text/plain");
+}
+
+void sendZoneState(RouteArgs& args) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(args.context);
+  server.send(200, "text/plain", relay->status() ? "1" : "0");
+}
+
+const RouteCommand IRRIGATION_COMMANDS[] = {
+  { ARG_OVERRIDE, ROUTE_ANY, setZoneOverride },
+  { ARG_STATE, SWITCH_STATUS, sendZoneState },
+  { ARG_STATE, ROUTE_ANY, switchZone },
+};
+const Route IRRIGATION_ROUTE = { ROUTE_TABLE(IRRIGATION_PARAMS), ROUTE_TABLE(IRRIGATION_COMMANDS), "ERROR: state command not specified" };
+
+void handleIrrigation() {
+  RouteArgs args;
+  router.parse(IRRIGATION_ROUTE, args);
+
+  McpIrrigationRelay* relay = findZoneByName(args.text(ARG_ZONE));
+  if (!relay) {
     char msg[60];
-    sprintf(msg, "ERROR: irrigation zone %s not found", suppliedZone);
+    sprintf(msg, "ERROR: irrigation zone %s not found", args.text(ARG_ZONE));
     server.send(404, "text/plain", msg);
     return;
   }
 
-  server.send(404, "text/plain", "ERROR: Unknown irrigation command");
+  if (debug) {
+    syslog.logf(LOG_INFO, "DEBUG: irrigation handling: zone arg: %s, relay name: %s", args.text(ARG_ZONE), relay->name);
+  }
+
+  char unknown[60];
+  snprintf(unknown, sizeof(unknown), "ERROR: state command not specified for %s", relay->name);
+  args.context = relay;
+  router.run(IRRIGATION_ROUTE, args, unknown);
+}
+
+// the scheduler only holds irrigation zones
+void logScheduledChange(RelayBase * r) {
+  McpIrrigationRelay * relay = static_cast<McpIrrigationRelay*>(r);
+  if (relay->on) countZoneRun(relay);
+  syslog.logf(LOG_INFO, "%s %s; Moisture: %d%%", relay->name, relay->state(), relay->moisturePercentage);
+  journal.record(relay->name, relay->on ? EVENT_ON : EVENT_OFF, relay->on ? relay->runTime : 0);
+}
+
+// a gauge for each zone's state and moisture, read from the relay at scrape
+// time, and a count of its runs
+void setupMetrics() {
+  for (uint8_t i = 0; i < IrrigationZones.size(); i++) {
+    McpIrrigationRelay * relay = IrrigationZones[i];
+
+    zoneOnGauges[i].setup("irrigation_zone_on", "1 while the zone is watering.");
+    zoneOnGauges[i].setLabel("zone", relay->name);
+    zoneOnGauges[i].setSource([](void* r) { return (double) static_cast<McpIrrigationRelay*>(r)->on; }, relay);
+    metrics.add(&zoneOnGauges[i]);
+
+    zoneMoistureGauges[i].setup("irrigation_zone_moisture_percent", "Soil moisture, -1 without a sensor.");
+    zoneMoistureGauges[i].setLabel("zone", relay->name);
+    zoneMoistureGauges[i].setSource([](void* r) { return (double) static_cast<McpIrrigationRelay*>(r)->moisturePercentage; }, relay);
+    metrics.add(&zoneMoistureGauges[i]);
+
+    zoneRunCounters[i].setup("irrigation_zone_runs_total", "Runs started by the schedule or the API.");
+    zoneRunCounters[i].setLabel("zone", relay->name);
+    metrics.add(&zoneRunCounters[i]);
+  }
+
+#ifdef LOCATION_BACKYARD
+  lightGauge.setSource([](void*) { return (double) veml.lux; });
+  metrics.add(&lightGauge);
+  doorGauge.setSource([](void*) { return (double) shedDoor->status(); });
+  metrics.add(&doorGauge);
+  i2cRecoveryCounter.setSource([](void*) { return (double) i2cBus.recoveries; });
+  metrics.add(&i2cRecoveryCounter);
+#endif
+
+  syslogDropCounter.setSource([](void*) { return (double) syslog.dropped; });
+  metrics.add(&syslogDropCounter);
+  syslogTruncateCounter.setSource([](void*) { return (double) syslog.truncated; });
+  metrics.add(&syslogTruncateCounter);
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&sensorPhase);
+  loopTimer.add(&relayPhase);
+  loopTimer.add(&syslogPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
+// where loop() spends its time, with the max and p99 of each phase
+void handleTiming() {
+  if (server.arg("reset") == "1") loopTimer.reset();
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+  loopTimer.writeJson(json);
+  json.endObject();
+  response.end();
+}
+
+// the events after ?since=, oldest first; poll again with the last seq seen
+void handleEvents() {
+  uint32_t since = strtoul(server.arg("since").c_str(), nullptr, 10);
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response, false);
+  json.beginObject();
+  journal.writeJson(json, since);
+  json.endObject();
+  response.end();
 }
 
 void setup() {
@@ -245,18 +389,27 @@ void setup() {
   sprintf(msg, "Alive! at IP: %s", (char*) WiFi.localIP().toString().c_str());
   Serial.println(msg);
   syslog.log(LOG_INFO, msg);
+  journal.begin(ESP.random());
+  journal.record(SYSTEM_APPNAME, EVENT_BOOT);
 
   // Setup OTA Update
+  // the update ends in a reboot, send what is still queued first
+  ArduinoOTA.onStart([]() { syslog.flush(); });
   ArduinoOTA.begin();
 
   configTime(MYTZ, "pool.ntp.org");
 
 #ifdef LOCATION_BACKYARD
-  // set I2C pins (SDA, SDL)
-  Wire.begin(GPIO0_PIN, GPIO2_PIN);
-  if (!mcp.begin_I2C()) {
+  // set I2C pins (SDA, SDL); the MCP and VEML both take 400kHz
+  if ( ! i2cBus.begin(GPIO0_PIN, GPIO2_PIN) ) {
+    syslog.log(LOG_ERR, "ERROR: I2C bus stuck at boot");
+  }
+  i2cBus.addDevice(MCP_ADDRESS, I2C_MCP23X17_MAX);
+  i2cBus.addDevice(VEML_ADDRESS, I2C_FAST_MODE);
+  if (!mcp.begin_I2C(MCP_ADDRESS)) {
     syslog.log(LOG_INFO, "ERROR: MCP setup failed");
   }
+  mcpPort.begin();
 
   if ( ! veml.setup() ) {
     syslog.log(LOG_INFO, "ERROR: veml setup failed");
@@ -264,6 +417,11 @@ void setup() {
   
   // setup the reed switch on the shed door
   shedDoor->setup("shed_door");
+#ifdef MCP_INT_PIN
+  if ( ! mcpInterrupts.begin(&mcp, MCP_INT_PIN) || ! shedDoor->useInterrupts(&mcpInterrupts) ) {
+    syslog.log(LOG_INFO, "ERROR: shed door interrupt setup failed");
+  }
+#endif
 #endif
 
   IrrigationZones.setStorage(storage_array);
@@ -271,13 +429,13 @@ void setup() {
   //TODO: add starttimes to status
   //maybe the mcp reference can be passed just once?
   //address, backwards?, Start, Mins, Schedule, EveryOtherDay?
-  IrrigationRelay * irz1 = new IrrigationRelay("patio_pots",  7, true, "7:00",  3, false, &mcp);
-  IrrigationRelay * irz2 = new IrrigationRelay("cottage",     6, true, "7:15", 15, true,  &mcp);
-  IrrigationRelay * irz3 = new IrrigationRelay("south_fence", 5, true, "7:30",  5, false, &mcp);
-  IrrigationRelay * irz4 = new IrrigationRelay("hill",        4, true, "7:45", 20, false,  &mcp);
-  IrrigationRelay * irz5 = new IrrigationRelay("back_fence",  2, true, "8:15", 15, false,  &mcp);
-  IrrigationRelay * irz6 = new IrrigationRelay("north_fence", 1, true, "8:30", 15, true,  &mcp);
-// IrrigationRelay * irz7 = new IrrigationRelay("garden",      3, true, "6:00", 8, &mcp);
+  McpIrrigationRelay * irz1 = STATIC_NEW(McpIrrigationRelay, "patio_pots",  7, true, "7:00",  3, false, &mcpPort);
+  McpIrrigationRelay * irz2 = STATIC_NEW(McpIrrigationRelay, "cottage",     6, true, "7:15", 15, true,  &mcpPort);
+  McpIrrigationRelay * irz3 = STATIC_NEW(McpIrrigationRelay, "south_fence", 5, true, "7:30",  5, false, &mcpPort);
+  McpIrrigationRelay * irz4 = STATIC_NEW(McpIrrigationRelay, "hill",        4, true, "7:45", 20, false, &mcpPort);
+  McpIrrigationRelay * irz5 = STATIC_NEW(McpIrrigationRelay, "back_fence",  2, true, "8:15", 15, false, &mcpPort);
+  McpIrrigationRelay * irz6 = STATIC_NEW(McpIrrigationRelay, "north_fence", 1, true, "8:30", 15, true,  &mcpPort);
+// McpIrrigationRelay * irz7 = STATIC_NEW(McpIrrigationRelay, "garden",      3, true, "6:00", 8, &mcpPort);
 // irz7->setStartTimeFromString(                                       "10:00");
 // irz7->setStartTimeFromString(                                       "14:00");
 // irz7->setStartTimeFromString(                                       "18:00");
@@ -288,6 +446,11 @@ void setup() {
   irz5->setup(); IrrigationZones.push_back(irz5);
   irz6->setup(); IrrigationZones.push_back(irz6);
 
+  scheduler.setStorage(scheduler_storage);
+  for (McpIrrigationRelay * relay : IrrigationZones) {
+    scheduler.add(relay);
+  }
+  setupMetrics();
 
   // Start the server
   server.on("/debug", handleDebug);
@@ -295,6 +458,9 @@ void setup() {
   server.on("/zones", handleZones);
   server.on("/door", handleDoor);
   server.on("/status", handleStatus);
+  server.on(HTTP_METRICS_ENDPOINT, handleMetrics);
+  server.on("/timing", handleTiming);
+  server.on("/events", handleEvents);
 #ifdef LOCATION_BACKYARD
   server.on("/sensors", handleSensors);
 #endif
@@ -305,25 +471,58 @@ void setup() {
 
 time_t prevTime = 0;;
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   time_t now = time(nullptr);
 #ifdef LOCATION_BACKYARD
+#ifdef MCP_INT_PIN
+  // the door only costs a bus read when the expander saw it move
+  mcpInterrupts.poll();
+  if ( shedDoor->handle() ) {
+    syslog.logf(LOG_INFO, "%s %s", shedDoor->name, shedDoor->state());
+    journal.record(shedDoor->name, shedDoor->status() ? EVENT_OPEN : EVENT_CLOSED);
+  }
+#else
   if (prevTime != now) {
     if ( shedDoor->handle() ) {
       syslog.logf(LOG_INFO, "%s %s", shedDoor->name, shedDoor->state());
+      journal.record(shedDoor->name, shedDoor->status() ? EVENT_OPEN : EVENT_CLOSED);
     }
   }
+#endif
   prevTime = now;
+
+  // pick up a finished light sample for the handlers to serve
+  i2cBus.call(VEML_ADDRESS, []() { return veml.handle() ? I2C_DONE : I2C_IDLE; });
+  loopTimer.lap(sensorPhase);
 #endif
 
-  for (IrrigationRelay * relay : IrrigationZones) {
-    if ( relay->handle() ) {
-      syslog.logf(LOG_INFO, "%s %s; Moisture: %f%%", relay->name, relay->state(), relay->moisturePercentage);
-    }
+  // only the zones that are due get handled
+  scheduler.run(logScheduledChange);
+
+#ifdef LOCATION_BACKYARD
+  // one bus write for whatever the zones switched this pass
+  i2cBus.call(MCP_ADDRESS, []() { return mcpPort.sync() ? I2C_DONE : I2C_IDLE; });
+#endif
+  loopTimer.lap(relayPhase);
+
+  // logs go out after the zones are handled
+  syslog.handle();
+  loopTimer.lap(syslogPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
   }
 
+  // rest while no zone is due, outside the timed pass and short enough
+  // that requests, OTA and the sensors don't wait on it
+  unsigned long idle = scheduler.idleMillis();
+  if (idle > 0) loopTimer.idle(idle < MAX_IDLE_MS ? idle : MAX_IDLE_MS);
 }
 
 
@@ -7,6 +7,11 @@
 #include <Vector.h>
 
 #include <my_relay.h>
+#include <my_arena.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
 
 #include <time.h>                       // time() ctime()
 #include <sys/time.h>                   // struct timeval
@@ -27,7 +32,14 @@ int debug = DEBUG;;
 
 // ESP-01 Pins
 
-Relay * powerswitch = new Relay(RELAY_PIN);
+Relay * powerswitch = STATIC_NEW(Relay, RELAY_PIN);
+
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
 
 void setup() {
   Serial.begin(115200);
@@ -60,7 +72,25 @@ void setup() {
   server.on("/debug", handleDebug);
   server.on("/power", handleSwitch);
   server.on("/status", handleStatus);
+  server.on("/metrics", handleMetrics);
   server.begin();
+
+  setupMetrics();
+}
+
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
 }
 
 void handleHelp() {
@@ -142,7 +172,14 @@ void handleSwitch() {
 }
 
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
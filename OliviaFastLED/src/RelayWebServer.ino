@@ -23,8 +23,14 @@
 #include <SPI.h>
 #include <FastLED.h>
 
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_arena.h>
+
 #include <my_relay.h>
-Relay * LED_Switch = new Relay(4);
+Relay * LED_Switch = STATIC_NEW(Relay, 4);
 
 #ifdef ESP32
 WebServer server(80);
@@ -49,6 +55,14 @@ Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, APP_NAME,
 int debug = 0;
 char msg[40];
 
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase ledPhase("leds");
+
 #define NUM_LEDS      300
 #define DATA_PIN        5
 #define VOLTS          12
@@ -125,8 +139,11 @@ void setup() {
   server.on("/status", handleStatus);
   //TODO make the url thingy showable in status
   server.on("/ledswitch", handleLedStrip);
+  server.on("/metrics", handleMetrics);
   server.begin();
 
+  setupMetrics();
+
   LED_Switch->setup("ledswitch");
 
   FastLED.setMaxPowerInVoltsAndMilliamps( VOLTS, MAX_MA);
@@ -166,8 +183,9 @@ void handleStatus() {
   JsonObject switches = doc.createNestedObject("switches");
 
   switches[LED_Switch->name]["state"] = LED_Switch->state();
-  switches[LED_Switch->name]["Last On Time"] = LED_Switch->prettyOnTime;
-  switches[LED_Switch->name]["Last Off Time"] = LED_Switch->prettyOffTime;
+  char buf[PRETTY_TIME_SIZE];
+  switches[LED_Switch->name]["Last On Time"] = LED_Switch->prettyOnTime(buf);
+  switches[LED_Switch->name]["Last Off Time"] = LED_Switch->prettyOffTime(buf);
 
   doc["debug"] = debug;
 
@@ -204,9 +222,28 @@ void handleLedStrip() {
   }
 }
 
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&ledPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   time_t now = time(nullptr);
 
@@ -223,7 +260,12 @@ void loop() {
 
     FastLED.show();
   }
+  loopTimer.lap(ledPhase);
 
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
 //  This function loops over each pixel, calculates the 
@@ -1,5 +1,5 @@
 #pragma once
 
 #define DEBUG 0
-#define JSON_SIZE 600
 #define MYTZ TZ_America_Los_Angeles
+#define HTTP_METRICS_ENDPOINT "/metrics"
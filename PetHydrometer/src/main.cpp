@@ -5,7 +5,6 @@
 #include <WiFiUdp.h>
 #include <Syslog.h>
 #include <ArduinoOTA.h>
-#include <ArduinoJson.h>
 #include <Arduino.h>
 #include <Vector.h>
 #include <Wire.h>
@@ -19,81 +18,124 @@
 #include <my_relay.h>
 #include <my_motion.h>
 #include <my_dht.h>
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_logqueue.h>
+#include <my_journal.h>
+#include <my_router.h>
+#include <my_arena.h>
 #include <Adafruit_Sensor.h>
 
 #include "config_default.h"
 #include "pet_config.h"
 
 ESP8266WebServer server(80);
+CommandRouter<ESP8266WebServer> router(server);
 
 #define SYSTEM_APPNAME "arduino"
 #define MISTER_APPNAME "mister"
 WiFiUDP udpClient;
-Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+Syslog syslogUdp(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, SYSTEM_APPNAME, LOG_LOCAL0);
+// messages wait here and go out from the end of loop()
+LogQueue syslog(syslogUdp, SYSTEM_APPNAME);
 
+#define MAX_DHT_SENSORS 8
+static_assert(PET.numSensors <= MAX_DHT_SENSORS, "more sensors than storage_array holds");
+PetSensorSet petSensorSet;
 Vector<myDHT*> DHTSensors;
-myDHT* storage_array[8];
+myDHT* storage_array[MAX_DHT_SENSORS];
 
 int debug = DEBUG;
 char msg[64];
-LCD * lcd = new LCD();
-MOTION * motion = new MOTION(D7); 
-IrrigationRelay * Mister = new IrrigationRelay(D3);
+LCD * lcd = STATIC_NEW(LCD);
+MOTION * motion = STATIC_NEW(MOTION, D7);
+IrrigationRelay * Mister = STATIC_NEW(IrrigationRelay, D3);
+
+MetricRegistry metrics;
+Gauge humidityGauges[MAX_DHT_SENSORS];
+Gauge temperatureGauges[MAX_DHT_SENSORS];
+Counter failureCounters[MAX_DHT_SENSORS];
+Gauge misterGauge(PET_NAME "_mister_on", "1 while the mister runs.");
+Counter syslogDropCounter("syslog_dropped_total", "Log messages dropped with the queue full.");
+Counter syslogTruncateCounter("syslog_truncated_total", "Log messages cut short to fit the queue.");
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase sensorPhase("sensors");
+LoopPhase relayPhase("relays");
+LoopPhase displayPhase("display");
+LoopPhase syslogPhase("syslog");
+
+// switches, doors and sensor alarms, for /events
+EventJournal journal;
+bool sensorFailing[MAX_DHT_SENSORS];
 
 void handleDebug() {
-  String levelArg = server.arg("level");
-  if (levelArg == "status") {
-    char msg[40];
-    sprintf(msg, "Debug level: %d", debug);
-    server.send(200, "text/plain", msg);
-  } else if (levelArg == "0" || levelArg == "1" || levelArg == "2") {
-    debug = levelArg.toInt();
-    syslog.logf(LOG_INFO, "Debug level %d", debug);
-    server.send(200, "text/plain");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown debug command");
-  }
+  router.dispatchDebug(debug, syslog);
 }
 
-void handleMister() {
-  if (server.arg("state") == "on") {
+enum MisterArg : uint8_t { ARG_STATE, ARG_ADD_TIME };
+const RouteParam MISTER_PARAMS[] = {
+  { "state", ROUTE_TABLE(SWITCH_CHOICES) },
+  { "addTime", nullptr, 0 },
+};
+
+void switchMister(RouteArgs& args) {
+  if (args.choice(ARG_STATE) == SWITCH_ON) {
     Mister->switchOn();
-    syslog.appName(MISTER_APPNAME);
-    syslog.logf(LOG_INFO, "Turned %s on for %ds", Mister->name, Mister->runTime);
-    syslog.appName(SYSTEM_APPNAME);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "off") {
-    Mister->switchOff();
-    syslog.appName(MISTER_APPNAME);
-    syslog.logf(LOG_INFO, "Turned %s off", Mister->name);
-    syslog.appName(SYSTEM_APPNAME);
-    server.send(200, "text/plain");
-  } else if (server.arg("state") == "status") {
-    server.send(200, "text/plain", Mister->on ? "1" : "0");
-  } else if (server.arg("addTime") != "") {
-    int timeToAdd = server.arg("addTime").toInt();
-    Mister->addTimeToRun(timeToAdd);
-    syslog.appName(MISTER_APPNAME);
-    syslog.logf(LOG_INFO, "Added %d seconds, total runtime now %ds, time left %ds", timeToAdd, Mister->runTime, Mister->getSecondsLeft());
-    syslog.appName(SYSTEM_APPNAME);
-    server.send(200, "text/plain");
+    syslog.logf(MISTER_APPNAME, LOG_INFO, "Turned %s on for %ds", Mister->name, Mister->runTime);
+    journal.record(Mister->name, EVENT_ON, Mister->runTime);
   } else {
-    server.send(404, "text/plain", "ERROR: unknown mister command");
+    Mister->switchOff();
+    syslog.logf(MISTER_APPNAME, LOG_INFO, "Turned %s off", Mister->name);
+    journal.record(Mister->name, EVENT_OFF);
   }
+  server.send(200, "text/plain");
+}
+
+void sendMisterState(RouteArgs&) {
+  server.send(200, "text/plain", Mister->on ? "1" : "0");
+}
+
+void addMisterTime(RouteArgs& args) {
+  int timeToAdd = args.toInt(ARG_ADD_TIME);
+  Mister->addTimeToRun(timeToAdd);
+  syslog.logf(MISTER_APPNAME, LOG_INFO, "Added %d seconds, total runtime now %ds, time left %ds", timeToAdd, Mister->runTime, Mister->getSecondsLeft());
+  server.send(200, "text/plain");
 }
 
+const RouteCommand MISTER_COMMANDS[] = {
+  { ARG_STATE, SWITCH_STATUS, sendMisterState },
+  { ARG_STATE, ROUTE_ANY, switchMister },
+  { ARG_ADD_TIME, ROUTE_ANY, addMisterTime },
+};
+const Route MISTER_ROUTE = { ROUTE_TABLE(MISTER_PARAMS), ROUTE_TABLE(MISTER_COMMANDS), "ERROR: unknown mister command" };
+
+void handleMister() {
+  router.dispatch(MISTER_ROUTE);
+}
+
+const RouteParam DISPLAY_PARAMS[] = { { "state", ROUTE_TABLE(SWITCH_CHOICES) } };
+
+void switchDisplay(RouteArgs& args) {
+  server.send(200, "text/plain");
+  bool on = args.choice(0) == SWITCH_ON;
+  lcd->setBackLight(on);
+  syslog.logf(LOG_INFO, "Turned LCD Display %s", on ? "on" : "off");
+}
+
+const RouteCommand DISPLAY_COMMANDS[] = {
+  { 0, SWITCH_ON, switchDisplay },
+  { 0, SWITCH_OFF, switchDisplay },
+};
+const Route DISPLAY_ROUTE = { ROUTE_TABLE(DISPLAY_PARAMS), ROUTE_TABLE(DISPLAY_COMMANDS), "ERROR: unknown display command" };
+
 void handleDisplay() {
-  if (server.arg("state") == "on") {
-    server.send(200, "text/plain");
-    lcd->setBackLight(true);
-    syslog.log(LOG_INFO, "Turned LCD Display on");
-  } else if (server.arg("state") == "off") {
-    server.send(200, "text/plain");
-    lcd->setBackLight(false);
-    syslog.log(LOG_INFO, "Turned LCD Display off");
-  } else {
-    server.send(404, "text/plain", "ERROR: unknown display command");
-  }
+  router.dispatch(DISPLAY_ROUTE);
 }
 
 void handleSensors() {
@@ -122,66 +164,122 @@ void handleSensors() {
   server.send(404, "text/plain", "ERROR: Sensor not found.");
 }
 
-void handlePrometheus() {
-
-  static size_t const BUFSIZE = 1024;
-  static char const *response_template =
-      "# HELP " PET_NAME "_air_humidity_percent Air humidity.\n"
-      "# TYPE " PET_NAME "_air_humidity_percent gauge\n"
-      "# UNIT " PET_NAME "_air_humidity_percent %%\n"
-      PET_NAME "_air_humidity_percent{petName=\"" PET_NAME "\",type=\"humidity\",sensorName=\"%s\"} %f\n"
-      "# HELP " PET_NAME "_air_temperature_fahrenheit Air temperature.\n"
-      "# TYPE " PET_NAME "_air_temperature_fahrenheit gauge\n"
-      "# UNIT " PET_NAME "_air_temperature_fahrenheit \u00B0F\n"
-      PET_NAME "_air_temperature_fahrenheit{petName=\"" PET_NAME "\",type=\"temperature\",sensorName=\"%s\"} %f\n"
-      ;
-  char response[BUFSIZE] = "";
-  size_t offset = 0;
+// one gauge of each kind per sensor, read straight from the myDHT when scraped;
+// the type label keeps /prometheus the series it was before the registry
+void setupMetrics() {
+  metrics.labels = "petName=\"" PET_NAME "\"";
+
+  uint8_t i = 0;
   for (myDHT* sensor : DHTSensors) {
-    offset += snprintf(response + offset, BUFSIZE - offset, response_template,
-                       sensor->sensorName, sensor->humid, sensor->sensorName, sensor->temp);
+    humidityGauges[i].setup(PET_NAME "_air_humidity_percent", "Air humidity.");
+    humidityGauges[i].labels = "type=\"humidity\"";
+    humidityGauges[i].setLabel("sensorName", sensor->sensorName);
+    humidityGauges[i].setSource([](void* s) { return static_cast<myDHT*>(s)->humid; }, sensor);
+    metrics.add(&humidityGauges[i]);
+
+    temperatureGauges[i].setup(PET_NAME "_air_temperature_fahrenheit", "Air temperature.");
+    temperatureGauges[i].labels = "type=\"temperature\"";
+    temperatureGauges[i].setLabel("sensorName", sensor->sensorName);
+    temperatureGauges[i].setSource([](void* s) { return static_cast<myDHT*>(s)->temp; }, sensor);
+    metrics.add(&temperatureGauges[i]);
+
+    failureCounters[i].setup(PET_NAME "_sensor_failures_total", "Failed sensor reads.");
+    failureCounters[i].setLabel("sensorName", sensor->sensorName);
+    failureCounters[i].setSource([](void* s) { return (double) static_cast<myDHT*>(s)->failures; }, sensor);
+    metrics.add(&failureCounters[i]);
+    i++;
   }
 
-    server.send(200, "text/plain; charset=utf-8", response);
+  misterGauge.setSource([](void* r) { return (double) static_cast<IrrigationRelay*>(r)->on; }, Mister);
+  metrics.add(&misterGauge);
+  syslogDropCounter.setSource([](void*) { return (double) syslog.dropped; });
+  metrics.add(&syslogDropCounter);
+  syslogTruncateCounter.setSource([](void*) { return (double) syslog.truncated; });
+  metrics.add(&syslogTruncateCounter);
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&sensorPhase);
+  loopTimer.add(&relayPhase);
+  loopTimer.add(&displayPhase);
+  loopTimer.add(&syslogPhase);
+  loopTimer.addTo(metrics);
 }
 
-void handleStatus() {
-  time_t now = time(nullptr);
-  StaticJsonDocument<JSON_SIZE> doc;
-  JsonObject switches = doc.createNestedObject("switches");
+void handleMetrics() {
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
 
-  switches["mister"]["state"] = Mister->state();
-  switches["mister"]["active"] = Mister->active;
-  switches["mister"]["RunTime (s)"] = Mister->runTime;
-  switches["mister"]["Time Left"] = Mister->timeLeftToRun;
-  switches["mister"]["Next Run Time"] = Mister->nextTimeToRun;
-  switches["mister"]["Last Run Time"] = Mister->prettyOnTime;
+// where loop() spends its time, with the max and p99 of each phase
+void handleTiming() {
+  if (server.arg("reset") == "1") loopTimer.reset();
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+  loopTimer.writeJson(json);
+  json.endObject();
+  response.end();
+}
 
-  JsonObject sensors = doc.createNestedObject("sensors");
+// the events after ?since=, oldest first; poll again with the last seq seen
+void handleEvents() {
+  uint32_t since = strtoul(server.arg("since").c_str(), nullptr, 10);
+
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response, false);
+  json.beginObject();
+  journal.writeJson(json, since);
+  json.endObject();
+  response.end();
+}
 
+void handleStatus() {
+  time_t now = time(nullptr);
+  ChunkedResponse<ESP8266WebServer> response(server);
+  response.begin(200, "text/plain");
+  JsonStream json(response);
+  json.beginObject();
+
+  json.beginObject("switches");
+  json.beginObject("mister");
+  json.add("state", Mister->state());
+  json.add("active", Mister->active);
+  json.add("RunTime (s)", Mister->runTime);
+  char buf[PRETTY_TIME_SIZE];
+  json.add("Time Left", Mister->timeLeftToRun(buf));
+  json.add("Next Run Time", Mister->nextTimeToRun(buf));
+  json.add("Last Run Time", Mister->prettyOnTime(buf));
+  json.endObject();
+  json.endObject();
+
+  // one object per sensor, however many there are
+  json.beginObject("sensors");
   for (myDHT* sensor : DHTSensors) {
-    sensors[sensor->sensorName]["humidity"] = sensor->humid;
-    sensors[sensor->sensorName]["temperature"] = sensor->temp;
+    json.beginObject(sensor->sensorName);
+    json.add("humidity", sensor->humid);
+    json.add("temperature", sensor->temp);
+    json.add("Sample Age (s)", now - sensor->sampleTime);
+    json.endObject();
   }
+  json.endObject();
 
-  doc["LCD Backlight Status"] = lcd->state;
-  doc["debug"] = debug;
+  json.add("LCD Backlight Status", lcd->state);
+  json.add("debug", debug);
 
   char timeString[20];
   struct tm *timeinfo = localtime(&now);
   strftime (timeString,20,"%D %T",timeinfo);
-  doc["time"] = timeString;
+  json.add("time", timeString);
 
-  size_t jsonDocSize = measureJsonPretty(doc);
-  if (jsonDocSize > JSON_SIZE) {
-    char msg[40];
-    sprintf(msg, "ERROR: JSON message too long, %d", jsonDocSize);
-    server.send(500, "text/plain", msg);
-  } else {
-    String httpResponse;
-    serializeJsonPretty(doc, httpResponse);
-    server.send(200, "text/plain", httpResponse);
-  }
+  json.endObject();
+  response.end();
 }
 
 void setup() {
@@ -191,6 +289,10 @@ void setup() {
   // set I2C pins (SDA, CLK)
   Wire.begin(D2, D1);
 
+  // prepare the motion sensor
+  motion->setup("motionsensor");
+  motion->useInterrupts();
+
   // Connect to WiFi network
   WiFi.mode(WIFI_STA);
   WiFi.hostname(DEVICE_HOSTNAME);
@@ -204,8 +306,12 @@ void setup() {
   sprintf(msg, "%s Alive! at IP: %s", DEVICE_HOSTNAME, (char*) WiFi.localIP().toString().c_str());
   Serial.println(msg);
   syslog.logf(LOG_INFO, "%s", msg);
+  journal.begin(ESP.random());
+  journal.record(SYSTEM_APPNAME, EVENT_BOOT);
 
   // Setup OTA Update
+  // the update ends in a reboot, send what is still queued first
+  ArduinoOTA.onStart([]() { syslog.flush(); });
   ArduinoOTA.begin();
 
   configTime(MYTZ, "pool.ntp.org");
@@ -216,7 +322,11 @@ void setup() {
   server.on("/display", handleDisplay);
   server.on("/sensors", handleSensors);
   server.on("/status", handleStatus);
-  server.on("/prometheus", handlePrometheus);
+  // the old path stays for the scrape jobs that already use it
+  server.on("/prometheus", handleMetrics);
+  server.on(HTTP_METRICS_ENDPOINT, handleMetrics);
+  server.on("/timing", handleTiming);
+  server.on("/events", handleEvents);
   server.begin();
 
   if (!lcd->begin(16, 2))  {
@@ -224,7 +334,8 @@ void setup() {
   }
 
   DHTSensors.setStorage(storage_array);
-  setupPet(Mister, DHTSensors);
+  setupPet(Mister, petSensorSet, DHTSensors);
+  setupMetrics();
 }
 
 void loop() {
@@ -234,11 +345,15 @@ void loop() {
   static int misterStatus = 0;
   static int prevMisterStatus = 0;
   static int avgHumidity = -1;
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
+  ClockSnapshot clock = clockSnapshot();
   prevTime = now;
-  now = time(nullptr);
+  now = clock.epoch;
 
   // check if there's a person and turn on the LCD backlight if there is
   motion->handle();
@@ -251,45 +366,59 @@ void loop() {
     syslog.log(LOG_INFO, "Nobody detected, turned backlight off");
   }
 
-  // Gather data from sensors, only supported up to every 2s 
-  int humiditySum = 0, sensorCount = 0;
-  if ( now != prevTime && now % 2 == 0 ) {
-    for (myDHT* sensor : DHTSensors) { 
-      sensor->handle(); 
-      // don't mist if above 60% humidity
+  // Gather data from sensors, each in its own slot of the 2s interval so
+  // a pass never does more than one transfer
+  bool sampled = false;
+  for (uint8_t i = 0; i < DHTSensors.size(); i++) {
+    myDHT* sensor = DHTSensors[i];
+    if (sensor->handle()) {
+      sampled = true;
+      // only the change, not every failed read
+      bool failing = sensor->getHumidity() < 0;
+      if (failing != sensorFailing[i]) {
+        sensorFailing[i] = failing;
+        journal.record(sensor->sensorName, failing ? EVENT_SENSOR_FAILED : EVENT_SENSOR_OK);
+      }
+      break;
+    }
+  }
+  if (sampled) {
+    // don't mist if above the humidity boundary
+    int humiditySum = 0, sensorCount = 0;
+    for (myDHT* sensor : DHTSensors) {
+      if (sensor->getHumidity() < 0) continue;
       humiditySum = humiditySum + sensor->getHumidity();
       sensorCount++;
     }
-    avgHumidity = humiditySum / sensorCount;
+    if (sensorCount > 0) avgHumidity = humiditySum / sensorCount;
   }
+  loopTimer.lap(sensorPhase);
 
   if (Mister->active && avgHumidity > Mister->moistureLevel) {
     Mister->setInActive();
-    syslog.appName(MISTER_APPNAME);
-    syslog.logf(LOG_INFO, "Setting mister INACTIVE.  Avg Humidity at %d, boundary at %d.", avgHumidity, Mister->moistureLevel);
-    syslog.appName(SYSTEM_APPNAME);
+    syslog.logf(MISTER_APPNAME, LOG_INFO, "Setting mister INACTIVE.  Avg Humidity at %d, boundary at %d.", avgHumidity, Mister->moistureLevel);
+    journal.record(Mister->name, EVENT_INACTIVE, avgHumidity);
   } 
   if (!Mister->active && avgHumidity < (Mister->moistureLevel - 1)) {
     Mister->setActive();
-    syslog.appName(MISTER_APPNAME);
-    syslog.logf(LOG_INFO, "Setting mister ACTIVE.  Humidity at %d, boundary at %d.", avgHumidity, Mister->moistureLevel);
-    syslog.appName(SYSTEM_APPNAME);
+    syslog.logf(MISTER_APPNAME, LOG_INFO, "Setting mister ACTIVE.  Humidity at %d, boundary at %d.", avgHumidity, Mister->moistureLevel);
+    journal.record(Mister->name, EVENT_ACTIVE, avgHumidity);
   }
 
   // Handle mister API requests and status changes
-  misterStatus = Mister->handle();
+  misterStatus = Mister->handle(clock);
 
   // mister changed state
   if (prevMisterStatus != misterStatus) {
-    syslog.appName(MISTER_APPNAME);
     if (Mister->on) {
-      syslog.logf(LOG_INFO, "Scheduled mister run started, humidity at %d: ", avgHumidity);
+      syslog.logf(MISTER_APPNAME, LOG_INFO, "Scheduled mister run started, humidity at %d: ", avgHumidity);
+      journal.record(Mister->name, EVENT_ON, Mister->runTime);
     } else {
-      syslog.logf(LOG_INFO, "Scheduled mister run finished, humidity at %d: ", avgHumidity);
+      syslog.logf(MISTER_APPNAME, LOG_INFO, "Scheduled mister run finished, humidity at %d: ", avgHumidity);
+      journal.record(Mister->name, EVENT_OFF);
     }
-      syslog.appName(SYSTEM_APPNAME);
   }
-
+  loopTimer.lap(relayPhase);
 
   // display sensor data or mister data on lcd
   if ( now != prevTime ) {
@@ -298,7 +427,8 @@ void loop() {
     // If the mister is running, show the count down timer
     if ( Mister->status() ) {
       char row1[20];
-      sprintf(row1, "Time left: %s", Mister->timeLeftToRun);
+      char timeLeft[TIME_LEFT_SIZE];
+      sprintf(row1, "Time left: %s", Mister->timeLeftToRun(timeLeft));
       lcd->print(row1);
       misterRan = true;
     } else {
@@ -328,4 +458,14 @@ void loop() {
       }
     }
   }
+  loopTimer.lap(displayPhase);
+
+  // logs go out once the mister and display are done
+  syslog.handle();
+  loopTimer.lap(syslogPhase);
+
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
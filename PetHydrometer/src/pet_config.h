@@ -1,6 +1,7 @@
 #ifndef PET_CONFIG_H
 #define PET_CONFIG_H
 
+#include <utility>
 #include <my_relay.h>
 #include <my_dht.h>
 #include <Vector.h>
@@ -16,40 +17,68 @@ struct PetConfig {
   const char* misterName;
   int misterRuntime;
   int humidityBoundary;
-  const char* startTimes[4];
+  int startMinutes[4];              // minuteOfDay("8:00"), worked out at compile time
   uint8_t numStartTimes;
   DHTSensorConfig sensors[2];
   uint8_t numSensors;
 };
 
-const PetConfig PET_CONFIGS[] = {
-  // hostname,      misterName,         runtime, boundary, startTimes,                          #times, sensors,                                          #sensors
-  {"iot-medusa",   "misting_system",    30,      70,       {"8:00", "12:00", "16:00", "20:00"}, 4,      {{"leftDHT", D5, DHT22}, {"rightDHT", D6, DHT22}}, 2},
-  {"iot-geckster", "misting_system",    30,      50,       {"8:00", "12:00", "16:00", "20:00"}, 4,      {{"DHT",     D5, DHT22}},                          1},
+constexpr PetConfig PET_CONFIGS[] = {
+  // hostname,      misterName,         runtime, boundary, startTimes,                                                                          #times, sensors,                                          #sensors
+  {"iot-medusa",   "misting_system",    30,      70,       {minuteOfDay("8:00"), minuteOfDay("12:00"), minuteOfDay("16:00"), minuteOfDay("20:00")}, 4,      {{"leftDHT", D5, DHT22}, {"rightDHT", D6, DHT22}}, 2},
+  {"iot-geckster", "misting_system",    30,      50,       {minuteOfDay("8:00"), minuteOfDay("12:00"), minuteOfDay("16:00"), minuteOfDay("20:00")}, 4,      {{"DHT",     D5, DHT22}},                          1},
 };
 
 #define NUM_PET_CONFIGS (sizeof(PET_CONFIGS) / sizeof(PetConfig))
 
-void setupPet(IrrigationRelay* mister, Vector<myDHT*>& sensors) {
-  for (size_t i = 0; i < NUM_PET_CONFIGS; i++) {
-    const PetConfig& config = PET_CONFIGS[i];
-    if (strcmp(DEVICE_HOSTNAME, config.hostname) != 0) continue;
-
-    mister->setup(config.misterName);
-    mister->setEveryDayOn();
-    for (uint8_t t = 0; t < config.numStartTimes; t++) {
-      mister->setStartTimeFromString(config.startTimes[t]);
-    }
-    mister->setRuntime(config.misterRuntime);
-    mister->setMoistureLevel(config.humidityBoundary);
-
-    for (uint8_t s = 0; s < config.numSensors; s++) {
-      myDHT* dht = new myDHT(config.sensors[s].pin, config.sensors[s].type);
-      dht->begin();
-      dht->setSensorName(config.sensors[s].name);
-      sensors.push_back(dht);
-    }
-    return;
+constexpr bool sameName(const char* a, const char* b) {
+  return *a == *b && (*a == '\0' || sameName(a + 1, b + 1));
+}
+
+// the entry for this device, picked by the compiler from DEVICE_HOSTNAME
+constexpr size_t petConfigIndex(size_t i = 0) {
+  return i == NUM_PET_CONFIGS || sameName(DEVICE_HOSTNAME, PET_CONFIGS[i].hostname) ? i : petConfigIndex(i + 1);
+}
+static_assert(petConfigIndex() < NUM_PET_CONFIGS, "no PET_CONFIGS entry for DEVICE_HOSTNAME");
+constexpr const PetConfig& PET = PET_CONFIGS[petConfigIndex() < NUM_PET_CONFIGS ? petConfigIndex() : 0];
+
+constexpr bool petStartTimesValid(uint8_t t = 0) {
+  return t == PET.numStartTimes || (PET.startMinutes[t] >= 0 && petStartTimesValid(t + 1));
+}
+static_assert(PET.numStartTimes <= sizeof(PET.startMinutes) / sizeof(int), "numStartTimes doesn't match the start times listed");
+static_assert(PET.numStartTimes <= IrrigationRelay::MAX_START_TIMES, "more start times than the mister holds");
+static_assert(petStartTimesValid(), "a mister start time isn't h:mm");
+static_assert(PET.numSensors >= 1 && PET.numSensors <= sizeof(PET.sensors) / sizeof(DHTSensorConfig), "numSensors doesn't match the sensors listed");
+
+// This device's sensors, built in static storage before setup() runs
+// instead of one new each.
+template <class Sensors> struct BasicPetSensorSet;
+
+template <size_t... I>
+struct BasicPetSensorSet<std::index_sequence<I...>> {
+  myDHT sensors[sizeof...(I)];
+
+  //constructor
+  BasicPetSensorSet(): sensors{ myDHT(PET.sensors[I].pin, PET.sensors[I].type)... } {}
+};
+
+typedef BasicPetSensorSet<std::make_index_sequence<PET.numSensors>> PetSensorSet;
+
+void setupPet(IrrigationRelay* mister, PetSensorSet& set, Vector<myDHT*>& sensors) {
+  mister->setup(PET.misterName);
+  mister->setEveryDayOn();
+  for (uint8_t t = 0; t < PET.numStartTimes; t++) {
+    mister->setStartTime(PET.startMinutes[t] / 60, PET.startMinutes[t] % 60);
+  }
+  mister->setRuntime(PET.misterRuntime);
+  mister->setMoistureLevel(PET.humidityBoundary);
+
+  for (uint8_t s = 0; s < PET.numSensors; s++) {
+    myDHT* dht = &set.sensors[s];
+    dht->begin();
+    dht->setSensorName(PET.sensors[s].name);
+    dht->setSlot(s, PET.numSensors);
+    sensors.push_back(dht);
   }
 }
 
@@ -0,0 +1,38 @@
+#ifndef FAKE_ADAFRUIT_ADS1X15_H
+#define FAKE_ADAFRUIT_ADS1X15_H
+
+#include <Wire.h>
+
+#define ADS1X15_REG_CONFIG_MUX_SINGLE_0 (0x4000)
+#define ADS1X15_REG_CONFIG_MUX_SINGLE_1 (0x5000)
+#define ADS1X15_REG_CONFIG_MUX_SINGLE_2 (0x6000)
+#define ADS1X15_REG_CONFIG_MUX_SINGLE_3 (0x7000)
+
+class Adafruit_ADS1015 {
+  public:
+    // shared by every instance, so a simulation can drive the inputs of
+    // one a library keeps to itself
+    static inline int16_t channels[4] = {0, 0, 0, 0};
+    static inline unsigned long transactions = 0;
+
+    bool begin(uint8_t address = 0x48, TwoWire* wire = &Wire) { (void) address; (void) wire; return true; }
+    int16_t readADC_SingleEnded(uint8_t channel) {
+      // single shot: configure, poll for completion, read the result
+      transactions += 3;
+      return channels[channel & 3];
+    }
+
+    // continuous mode: one config write, then each read is the latest result
+    uint8_t muxChannel = 0;
+    void startADCReading(uint16_t mux, bool continuous) {
+      (void) continuous;
+      transactions++;
+      muxChannel = (mux >> 12) & 3;
+    }
+    int16_t getLastConversionResults() {
+      transactions++;
+      return channels[muxChannel];
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef FAKE_ADAFRUIT_MCP23X17_H
+#define FAKE_ADAFRUIT_MCP23X17_H
+
+#include <Wire.h>
+#include <fake_hal.h>
+
+// Port expander with the register behaviour the relays rely on. Every call
+// that would touch the bus on the real part bumps transactions, counted the
+// way the Adafruit driver does it (digitalWrite is a read-modify-write).
+class Adafruit_MCP23X17 {
+  public:
+    uint16_t iodir = 0xFFFF;
+    uint16_t olat = 0;
+    uint16_t inputs = 0xFFFF;   // levels driven onto the pins from outside
+    unsigned long transactions = 0;
+
+    // interrupt on change, with INTA/INTB mirrored onto the native intPin
+    uint16_t gpinten = 0;
+    uint16_t intcap = 0;
+    bool intActive = false;
+    int intPin = -1;
+
+    bool begin_I2C(uint8_t address = 0x20, TwoWire* wire = &Wire) { (void) address; (void) wire; transactions++; return true; }
+
+    void pinMode(uint8_t pin, uint8_t mode) {
+      transactions += 2;
+      if (mode == OUTPUT) { iodir &= ~bit(pin); } else { iodir |= bit(pin); }
+    }
+    uint8_t digitalRead(uint8_t pin) {
+      transactions++;
+      return (readPins() & bit(pin)) ? HIGH : LOW;
+    }
+    void digitalWrite(uint8_t pin, uint8_t value) {
+      transactions += 2;
+      if (value == HIGH) { olat |= bit(pin); } else { olat &= ~bit(pin); }
+    }
+    // reading GPIO releases INT too, INTCAP keeps the capture
+    uint16_t readGPIOAB() { transactions++; if (intActive) releaseInt(); return readPins(); }
+    void writeGPIOAB(uint16_t value) { transactions++; olat = value; }
+
+    void setupInterrupts(bool mirroring, bool openDrain, uint8_t polarity) {
+      (void) mirroring; (void) openDrain; (void) polarity;
+      transactions += 4;
+    }
+    void setupInterruptPin(uint8_t pin, uint8_t mode = CHANGE) {
+      (void) mode;
+      transactions += 4;
+      gpinten |= bit(pin);
+    }
+    // reading INTCAP releases INT
+    uint16_t getCapturedInterrupt() {
+      transactions += 2;
+      releaseInt();
+      return intcap;
+    }
+    void clearInterrupts() { transactions += 2; releaseInt(); }
+
+    // drive an input from outside; like the part, the first change on an
+    // enabled pin latches INTCAP and pulls INT low until it is read
+    void setInput(uint8_t pin, int level) {
+      uint16_t before = readPins();
+      if (level == HIGH) { inputs |= bit(pin); } else { inputs &= ~bit(pin); }
+      if (((before ^ readPins()) & gpinten & iodir) && !intActive) {
+        intcap = readPins();
+        intActive = true;
+        if (intPin >= 0) fakehal::setPinInput(intPin, LOW);
+      }
+    }
+
+  private:
+    static uint16_t bit(uint8_t pin) { return (uint16_t) (1u << pin); }
+    uint16_t readPins() { return (olat & ~iodir) | (inputs & iodir); }
+    void releaseInt() {
+      intActive = false;
+      if (intPin >= 0) fakehal::setPinInput(intPin, HIGH);
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef FAKE_ADAFRUIT_VEML7700_H
+#define FAKE_ADAFRUIT_VEML7700_H
+
+#include <Wire.h>
+#include "fake_hal.h"
+
+#define VEML7700_GAIN_1   0x00
+#define VEML7700_GAIN_2   0x01
+#define VEML7700_GAIN_1_8 0x02
+#define VEML7700_GAIN_1_4 0x03
+
+#define VEML7700_IT_100MS 0x00
+#define VEML7700_IT_200MS 0x01
+#define VEML7700_IT_400MS 0x02
+#define VEML7700_IT_800MS 0x03
+#define VEML7700_IT_50MS  0x08
+#define VEML7700_IT_25MS  0x0C
+
+typedef enum {
+  VEML_LUX_NORMAL,
+  VEML_LUX_CORRECTED,
+  VEML_LUX_AUTO,
+  VEML_LUX_NORMAL_NOWAIT,
+  VEML_LUX_CORRECTED_NOWAIT
+} luxMethod;
+
+class Adafruit_VEML7700 {
+  uint8_t gain = VEML7700_GAIN_1;
+  uint8_t integrationTime = VEML7700_IT_100MS;
+
+  public:
+    unsigned long transactions = 0;
+
+    bool begin(TwoWire* wire = &Wire) { (void) wire; transactions++; return true; }
+    void enable(bool a) { (void) a; transactions++; }
+    void setGain(uint8_t a) { gain = a; transactions++; }
+    uint8_t getGain() { return gain; }
+    // like the driver, waits out the old integration unless told not to
+    void setIntegrationTime(uint8_t a, bool wait = true) {
+      if (wait) delay(integrationMs());
+      integrationTime = a;
+      transactions++;
+    }
+    uint8_t getIntegrationTime() { return integrationTime; }
+    void setLowThreshold(uint16_t a) { (void) a; transactions++; }
+    void setHighThreshold(uint16_t a) { (void) a; transactions++; }
+    void interruptEnable(bool a) { (void) a; transactions++; }
+    // like the driver, the waiting methods sleep out an integration
+    float readLux(luxMethod method = VEML_LUX_NORMAL) {
+      transactions++;
+      if (method != VEML_LUX_NORMAL_NOWAIT && method != VEML_LUX_CORRECTED_NOWAIT) delay(integrationMs());
+      return fakehal::lux();
+    }
+
+    // counts for the ambient light at the current gain and integration time
+    uint16_t readALS() {
+      transactions++;
+      double counts = fakehal::lux() / (0.0036 * (800.0 / integrationMs()) * (2.0 / gainValue()));
+      return counts > 65535 ? 65535 : (uint16_t) counts;
+    }
+
+  private:
+    double gainValue() {
+      switch (gain) {
+        case VEML7700_GAIN_2:   return 2;
+        case VEML7700_GAIN_1_8: return .125;
+        case VEML7700_GAIN_1_4: return .25;
+      }
+      return 1;
+    }
+    unsigned long integrationMs() {
+      switch (integrationTime) {
+        case VEML7700_IT_25MS:  return 25;
+        case VEML7700_IT_50MS:  return 50;
+        case VEML7700_IT_200MS: return 200;
+        case VEML7700_IT_400MS: return 400;
+        case VEML7700_IT_800MS: return 800;
+      }
+      return 100;
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef FAKE_ARDUINO_H
+#define FAKE_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core used by ~/platformio/lib.
+// Pin levels, analog values and the clock live in fake_hal.h so a simulation
+// can drive them.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x00
+#define OUTPUT       0x01
+#define INPUT_PULLUP 0x02
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define A0 17
+
+#define NUM_DIGITAL_PINS 17
+#define NOT_AN_INTERRUPT -1
+// like the ESP8266, every pin but GPIO16 can interrupt
+#define digitalPinToInterrupt(p) ((p) < 16 ? (p) : NOT_AN_INTERRUPT)
+
+#define F(s) (s)
+#define PSTR(s) (s)
+#define PROGMEM
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000UL);
+
+// handlers run inside fakehal::setPinInput() when the level change matches mode
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void configTime(const char* tz, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+
+class String {
+  std::string s;
+
+  public:
+    String() {}
+    String(const char* a) : s(a ? a : "") {}
+    String(const std::string& a) : s(a) {}
+    String(int a) : s(std::to_string(a)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    long toInt() const { return atol(s.c_str()); }
+
+    String& operator+=(const String& a) { s += a.s; return *this; }
+    String& operator+=(const char* a) { s += a; return *this; }
+    String& operator+=(char a) { s += a; return *this; }
+    String& operator+=(int a) { s += std::to_string(a); return *this; }
+
+    bool operator==(const String& a) const { return s == a.s; }
+    bool operator==(const char* a) const { return s == a; }
+    bool operator!=(const char* a) const { return s != a; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    size_t print(const char* a) { return write((const uint8_t*) a, strlen(a)); }
+    size_t print(const String& a) { return print(a.c_str()); }
+    size_t print(int a) { return print((long) a); }
+    size_t print(unsigned long a) { char buf[24]; snprintf(buf, sizeof(buf), "%lu", a); return print(buf); }
+    size_t print(long a) { char buf[24]; snprintf(buf, sizeof(buf), "%ld", a); return print(buf); }
+    size_t print(double a) { char buf[32]; snprintf(buf, sizeof(buf), "%.2f", a); return print(buf); }
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(T a) { return print(a) + println(); }
+};
+
+// Serial output is swallowed unless the simulation asks to see it
+class HardwareSerial : public Print {
+  public:
+    bool echo = false;
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { if (echo) putchar(c); return 1; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
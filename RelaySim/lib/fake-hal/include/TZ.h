@@ -0,0 +1,7 @@
+#ifndef FAKE_TZ_H
+#define FAKE_TZ_H
+
+// POSIX rules as in the ESP8266 core TZ.h, applied by the fake configTime()
+#define TZ_America_Los_Angeles PSTR("PST8PDT,M3.2.0,M11.1.0")
+
+#endif
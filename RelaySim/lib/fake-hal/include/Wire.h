@@ -0,0 +1,27 @@
+#ifndef FAKE_WIRE_H
+#define FAKE_WIRE_H
+
+#include <Arduino.h>
+
+class TwoWire {
+  uint8_t txAddress = 0;
+
+  public:
+    unsigned long transactions = 0;
+    uint32_t clock = 100000;
+    bool present[128] = {};     // addresses that ACK
+
+    void begin() {}
+    void begin(int sda, int scl) { (void) sda; (void) scl; }
+    void setClock(uint32_t a) { clock = a; }
+    void beginTransmission(uint8_t address) { txAddress = address & 0x7f; }
+    uint8_t endTransmission(bool sendStop = true) { (void) sendStop; transactions++; return present[txAddress] ? 0 : 2; }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) { (void) address; (void) quantity; transactions++; return 0; }
+    size_t write(uint8_t c) { (void) c; return 1; }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif
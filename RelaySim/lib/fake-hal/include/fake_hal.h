@@ -0,0 +1,32 @@
+#ifndef FAKE_HAL_H
+#define FAKE_HAL_H
+
+// Controls for the host fake HAL. The simulation owns the clock: nothing moves
+// unless it calls advance*(), and delay() in library code costs simulated time.
+
+#include <Arduino.h>
+
+namespace fakehal {
+  const int NUM_PINS = 32;
+
+  void setTime(time_t epoch);
+  time_t now();
+  uint64_t nowMicros();
+  void advanceMicros(uint64_t us);
+  void advanceSeconds(time_t s);
+
+  // native GPIO; a level change runs an attached interrupt handler
+  void setPinInput(uint8_t pin, int level);
+  int pinOutput(uint8_t pin);
+  void setAnalog(uint8_t pin, int value);
+  unsigned long pinWrites();
+
+  // ambient light seen by every VEML7700
+  void setLux(float lux);
+  float lux();
+
+  // time() replacement installed with setClockSource()
+  time_t clock();
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "fake_hal.h"
+#include <Wire.h>
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+static uint64_t simMicros = 0;
+static uint8_t pinModes[fakehal::NUM_PINS];
+static int pinInputs[fakehal::NUM_PINS];
+static int pinOutputs[fakehal::NUM_PINS];
+static int analogValues[fakehal::NUM_PINS];
+static unsigned long writes = 0;
+static float ambientLux = 0;
+
+struct Interrupt {
+  void (*handler)(void*);
+  void* arg;
+  int mode;
+};
+static Interrupt pinInterrupts[fakehal::NUM_PINS];
+static bool interruptsEnabled = true;
+
+void fakehal::setTime(time_t epoch) {
+  simMicros = (uint64_t) epoch * 1000000ULL;
+}
+
+time_t fakehal::now() {
+  return (time_t) (simMicros / 1000000ULL);
+}
+
+uint64_t fakehal::nowMicros() {
+  return simMicros;
+}
+
+void fakehal::advanceMicros(uint64_t us) {
+  simMicros += us;
+}
+
+void fakehal::advanceSeconds(time_t s) {
+  simMicros += (uint64_t) s * 1000000ULL;
+}
+
+void fakehal::setPinInput(uint8_t pin, int level) {
+  int prev = pinInputs[pin % NUM_PINS];
+  pinInputs[pin % NUM_PINS] = level;
+
+  Interrupt& isr = pinInterrupts[pin % NUM_PINS];
+  if (isr.handler == nullptr || !interruptsEnabled || prev == level) return;
+  if (isr.mode == CHANGE || (isr.mode == RISING && level == HIGH) || (isr.mode == FALLING && level == LOW)) {
+    isr.handler(isr.arg);
+  }
+}
+
+int fakehal::pinOutput(uint8_t pin) {
+  return pinOutputs[pin % NUM_PINS];
+}
+
+void fakehal::setAnalog(uint8_t pin, int value) {
+  analogValues[pin % NUM_PINS] = value;
+}
+
+unsigned long fakehal::pinWrites() {
+  return writes;
+}
+
+void fakehal::setLux(float lux) {
+  ambientLux = lux;
+}
+
+float fakehal::lux() {
+  return ambientLux;
+}
+
+time_t fakehal::clock() {
+  return now();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  pinModes[pin % fakehal::NUM_PINS] = mode;
+  if (mode == INPUT_PULLUP) pinInputs[pin % fakehal::NUM_PINS] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  pinOutputs[pin % fakehal::NUM_PINS] = val;
+  writes++;
+}
+
+int digitalRead(uint8_t pin) {
+  if (pinModes[pin % fakehal::NUM_PINS] == OUTPUT) return pinOutputs[pin % fakehal::NUM_PINS];
+  return pinInputs[pin % fakehal::NUM_PINS];
+}
+
+int analogRead(uint8_t pin) {
+  return analogValues[pin % fakehal::NUM_PINS];
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+  (void) pin; (void) state;
+  // no echo ever comes back on the host, so this always times out
+  simMicros += timeout;
+  return 0;
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {
+  pinInterrupts[pin % fakehal::NUM_PINS] = { handler, arg, mode };
+}
+
+void detachInterrupt(uint8_t pin) {
+  pinInterrupts[pin % fakehal::NUM_PINS] = { nullptr, nullptr, 0 };
+}
+
+void noInterrupts() {
+  interruptsEnabled = false;
+}
+
+void interrupts() {
+  interruptsEnabled = true;
+}
+
+unsigned long millis() {
+  return (unsigned long) (simMicros / 1000ULL);
+}
+
+unsigned long micros() {
+  return (unsigned long) simMicros;
+}
+
+void delay(unsigned long ms) {
+  simMicros += (uint64_t) ms * 1000ULL;
+}
+
+void delayMicroseconds(unsigned int us) {
+  simMicros += us;
+}
+
+void yield() {}
+
+void configTime(const char* tz, const char* server1, const char* server2, const char* server3) {
+  (void) server1; (void) server2; (void) server3;
+  setenv("TZ", tz, 1);
+  tzset();
+}
@@ -0,0 +1,273 @@
+// Host simulation of the relay library against the fake HAL.
+//
+// Runs the BackyardShed zone table, a FrontYard style moisture zone, the
+// PetHydrometer mister and the light relays through simulated days, then
+// reports how fast simulated time moves and what each handle() call costs.
+//
+//   .pio/build/native/program [days] [loops per simulated second] [poll|scheduler|moisture]
+//
+// poll calls handle() on every relay each pass like the sketches used to;
+// scheduler hands them all to a RelayScheduler and only runs the due ones.
+// moisture polls too, with the first MOISTURE_ZONES zones on one shared
+// ADS1015 whose readings are noisy and now and then way off, and counts how
+// often their dry/wet decision flips against deciding on each raw reading.
+
+#include <chrono>
+#include <math.h>
+
+#include <fake_hal.h>
+#include <Adafruit_MCP23X17.h>
+#include <my_mcp.h>
+#include <my_relay.h>
+#include <my_scheduler.h>
+#include <my_moisture.h>
+
+#include "../../BackyardShed/src/irrigation_config.h"
+
+// 2026-01-01 00:00:00 PST
+const time_t SIM_START = 1767254400;
+const int MOISTURE_PIN = A0;
+const uint8_t MOISTURE_ZONES = 3;
+const int MOISTURE_ZONE_PERCENT = 50;
+
+struct Bench {
+  const char* name;
+  unsigned long calls = 0;
+  unsigned long events = 0;
+  double nanos = 0;
+};
+
+Adafruit_MCP23X17 mcp;
+McpPort mcpPort(&mcp);
+IrrigationZoneSet irrigationZoneSet(&mcpPort);
+Vector<McpIrrigationRelay*> IrrigationZones;
+McpIrrigationRelay * storage_array[NUM_IRRIGATION_ZONES];
+
+IrrigationRelay * frontyard = new IrrigationRelay(14);
+IrrigationRelay * mister = new IrrigationRelay(0);
+ScheduleRelay * cottageLights = new ScheduleRelay(1);
+DuskToDawnScheduleRelay * lvLights = new DuskToDawnScheduleRelay(2);
+
+Bench zoneBench = { "IrrigationRelay (mcp zones)" };
+Bench frontyardBench = { "IrrigationRelay (moisture)" };
+Bench misterBench = { "IrrigationRelay (mister)" };
+Bench scheduleBench = { "ScheduleRelay" };
+Bench duskBench = { "DuskToDawnScheduleRelay" };
+Bench schedulerBench = { "RelayScheduler::run" };
+
+RelayScheduler scheduler;
+RelayScheduler::Entry scheduler_storage[NUM_IRRIGATION_ZONES + 4];
+bool useScheduler = false;
+
+MoistureSampler moistureSampler;
+bool useMoisture = false;
+bool rawDry[MOISTURE_ZONES];
+bool filteredDry[MOISTURE_ZONES];
+unsigned long rawFlips = 0;
+unsigned long filteredFlips = 0;
+
+template <typename T>
+void timedHandle(T * relay, const ClockSnapshot & clock, Bench & bench) {
+  auto start = std::chrono::steady_clock::now();
+  bool changed = relay->handle(clock);
+  auto end = std::chrono::steady_clock::now();
+  bench.nanos += std::chrono::duration<double, std::nano>(end - start).count();
+  bench.calls++;
+  if (changed) bench.events++;
+}
+
+// the same calibration IrrigationRelay uses, on a single raw reading
+bool isDry(int level) {
+  if (level > 660) level = 660;
+  if (level < 330) level = 330;
+  return 100 - ((level - 330) * 100 + 165) / 330 < MOISTURE_ZONE_PERCENT;
+}
+
+// each moisture zone's soil dries out and is watered like the frontyard's,
+// read with +/-10 counts of noise and a 300 count spike 2% of the time
+void updateZoneSoil() {
+  static int soil[MOISTURE_ZONES] = { 480, 500, 520 };
+  static uint32_t seed = 1;
+
+  for (uint8_t i = 0; i < MOISTURE_ZONES; i++) {
+    McpIrrigationRelay * relay = IrrigationZones[i];
+    if (relay->on) {
+      soil[i] = soil[i] > 340 ? soil[i] - 1 : soil[i];
+    } else if (fakehal::now() % 120 == 0) {
+      soil[i] = soil[i] < 650 ? soil[i] + 1 : soil[i];
+    }
+
+    seed = seed * 1103515245 + 12345;
+    int reading = soil[i] + (int) ((seed >> 16) % 21) - 10;
+    if ((seed >> 8) % 100 < 2) reading += (seed & 1) ? 300 : -300;
+    Adafruit_ADS1015::channels[i] = reading;
+
+    bool dry = isDry(reading);
+    if (dry != rawDry[i]) rawFlips++;
+    rawDry[i] = dry;
+    if (relay->dry != filteredDry[i]) filteredFlips++;
+    filteredDry[i] = relay->dry;
+  }
+}
+
+// daylight curve for the VEML and a soil that dries out between waterings
+void updateEnvironment(time_t now) {
+  struct tm *timeinfo = localtime(&now);
+  double hour = timeinfo->tm_hour + timeinfo->tm_min / 60.0;
+  double daylight = sin(M_PI * (hour - 6) / 12);
+  fakehal::setLux(daylight > 0 ? 2000 * daylight : 5);
+
+  static int soil = 400;
+  if (frontyard->on) {
+    soil = soil > 340 ? soil - 1 : soil;
+  } else if (now % 120 == 0) {
+    soil = soil < 650 ? soil + 1 : soil;
+  }
+  fakehal::setAnalog(MOISTURE_PIN, soil);
+
+  if (useMoisture) updateZoneSoil();
+}
+
+void setup() {
+  fakehal::setTime(SIM_START);
+  setClockSource(fakehal::clock);
+
+  mcp.begin_I2C();
+  mcpPort.begin();
+  IrrigationZones.setStorage(storage_array);
+  setupIrrigationZones(IrrigationZones, irrigationZoneSet);
+
+  if (useMoisture) {
+    moistureSampler.begin();
+    for (uint8_t i = 0; i < MOISTURE_ZONES; i++) {
+      IrrigationZones[i]->setMoistureSensor(&moistureSampler, i, MOISTURE_ZONE_PERCENT);
+      rawDry[i] = filteredDry[i] = IrrigationZones[i]->dry;
+    }
+  }
+
+  frontyard->setup("frontyard");
+  frontyard->setRuntime(10*60);
+  frontyard->setStartTime(8, 15);
+  frontyard->setMoistureSensor(MOISTURE_PIN, 70);
+  frontyard->setMoistureLimits(660, 330);
+
+  mister->setup("misting_system");
+  mister->setStartTimeFromString("8:00");
+  mister->setStartTimeFromString("12:00");
+  mister->setStartTimeFromString("16:00");
+  mister->setStartTimeFromString("20:00");
+  mister->setRuntime(30);
+
+  cottageLights->setup("lightswitch");
+  cottageLights->setOnOffTimes(18, 0, 22, 30);
+
+  lvLights->setup("lvlights");
+  lvLights->setNightOffOnHours(0, 5);
+  lvLights->setDusk(70);
+  lvLights->setVemlLightSensor();
+
+  if (useScheduler) {
+    scheduler.setStorage(scheduler_storage);
+    for (McpIrrigationRelay * relay : IrrigationZones) {
+      scheduler.add(relay);
+    }
+    scheduler.add(frontyard);
+    scheduler.add(mister);
+    scheduler.add(cottageLights);
+    scheduler.add(lvLights);
+  }
+}
+
+void countChange(RelayBase * relay) {
+  (void) relay;
+  schedulerBench.events++;
+}
+
+void loop() {
+  if (useScheduler) {
+    auto start = std::chrono::steady_clock::now();
+    scheduler.run(countChange);
+    auto end = std::chrono::steady_clock::now();
+    schedulerBench.nanos += std::chrono::duration<double, std::nano>(end - start).count();
+    schedulerBench.calls++;
+    mcpPort.sync();
+    return;
+  }
+
+  if (useMoisture) moistureSampler.handle();
+
+  ClockSnapshot clock = clockSnapshot();
+  for (McpIrrigationRelay * relay : IrrigationZones) {
+    timedHandle(relay, clock, zoneBench);
+  }
+  timedHandle(frontyard, clock, frontyardBench);
+  timedHandle(mister, clock, misterBench);
+  timedHandle(cottageLights, clock, scheduleBench);
+  timedHandle(lvLights, clock, duskBench);
+  mcpPort.sync();
+}
+
+void report(Bench & bench) {
+  printf("  %-30s %10lu calls %8.1f ns/call %6lu events\n",
+         bench.name, bench.calls, bench.calls ? bench.nanos / bench.calls : 0, bench.events);
+}
+
+int main(int argc, char** argv) {
+  long days = argc > 1 ? atol(argv[1]) : 365;
+  long loopsPerSecond = argc > 2 ? atol(argv[2]) : 1;
+  if (days < 1) days = 1;
+  if (loopsPerSecond < 1) loopsPerSecond = 1;
+  useScheduler = argc > 3 && strcmp(argv[3], "scheduler") == 0;
+  useMoisture = argc > 3 && strcmp(argv[3], "moisture") == 0;
+
+  setup();
+
+  const time_t simSeconds = days * 24 * 60 * 60;
+  const uint64_t loopMicros = 1000000ULL / loopsPerSecond;
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (time_t s = 0; s < simSeconds; s++) {
+    updateEnvironment(fakehal::now());
+    uint64_t secondEnd = fakehal::nowMicros() + 1000000ULL;
+    for (long l = 0; l < loopsPerSecond; l++) {
+      loop();
+      if (fakehal::nowMicros() < secondEnd) fakehal::advanceMicros(loopMicros);
+    }
+    // library code may have burnt simulated time with delay()
+    if (fakehal::nowMicros() < secondEnd) fakehal::advanceMicros(secondEnd - fakehal::nowMicros());
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printf("simulated %ld days (%ld s) at %ld loops/s in %.2f s wall\n", days, (long) simSeconds, loopsPerSecond, wallSeconds);
+  printf("  %.0f simulated seconds per wall second\n", simSeconds / wallSeconds);
+  if (useScheduler) {
+    report(schedulerBench);
+    printf("  %lu handle() calls dispatched\n", scheduler.dispatches);
+  } else {
+    report(zoneBench);
+    report(frontyardBench);
+    report(misterBench);
+    report(scheduleBench);
+    report(duskBench);
+  }
+  printf("  mcp i2c transactions: %lu (%lu port reads, %lu port writes)\n",
+         mcp.transactions, mcpPort.busReads, mcpPort.busWrites);
+
+  if (useMoisture) {
+    printf("  ads i2c transactions: %lu (%.2f per zone-second, %lu samples)\n",
+           Adafruit_ADS1015::transactions, (double) Adafruit_ADS1015::transactions / (MOISTURE_ZONES * simSeconds),
+           moistureSampler.samples);
+    printf("  dry/wet flips: %lu filtered, %lu deciding on each raw reading\n", filteredFlips, rawFlips);
+  }
+
+  printf("  %zu bytes per zone relay\n", sizeof(McpIrrigationRelay));
+
+  char lastRun[PRETTY_TIME_SIZE];
+  printf("zone runs:\n");
+  for (McpIrrigationRelay * relay : IrrigationZones) {
+    printf("  %-14s last run %s\n", relay->name, relay->prettyOnTime(lastRun));
+  }
+  printf("  %-14s last run %s, moisture %d%%\n", frontyard->name, frontyard->prettyOnTime(lastRun), frontyard->moisturePercentage);
+  return 0;
+}
@@ -0,0 +1,80 @@
+// pio test -e native
+//
+// MoistureFilter and MoistureSampler against the fake ADS1015.
+
+#include <unity.h>
+#include <fake_hal.h>
+#include <my_moisture.h>
+
+void setUp() {
+  for (uint8_t c = 0; c < 4; c++) Adafruit_ADS1015::channels[c] = 0;
+  Adafruit_ADS1015::transactions = 0;
+}
+
+void tearDown() {}
+
+void test_no_level_before_first_reading() {
+  MoistureFilter filter;
+  TEST_ASSERT_EQUAL(-1, filter.level());
+  filter.add(500);
+  TEST_ASSERT_EQUAL(500, filter.level());
+}
+
+void test_spike_is_ignored() {
+  MoistureFilter filter;
+  for (int i = 0; i < 5; i++) filter.add(500);
+  filter.add(800);
+  TEST_ASSERT_EQUAL(500, filter.level());
+  filter.add(200);
+  TEST_ASSERT_EQUAL(500, filter.level());
+}
+
+// a reading just under GND used to look like "no reading yet" and reseed
+// the filter every time, so the zone never got a level
+void test_negative_reading_counts_as_zero() {
+  MoistureFilter filter;
+  for (int i = 0; i < 5; i++) filter.add(-3);
+  TEST_ASSERT_EQUAL(0, filter.level());
+  for (int i = 0; i < 40; i++) filter.add(400);
+  TEST_ASSERT_EQUAL(400, filter.level());
+}
+
+void test_sampler_cycles_watched_channels() {
+  fakehal::setTime(1767254400);
+  MoistureSampler sampler;
+  sampler.begin();
+  Adafruit_ADS1015::channels[0] = 300;
+  Adafruit_ADS1015::channels[2] = 600;
+  sampler.watch(0);
+  sampler.watch(2);
+
+  for (int i = 0; i < 4; i++) {
+    fakehal::advanceMicros(sampler.sampleIntervalMs * 1000);
+    TEST_ASSERT_TRUE(sampler.handle());
+  }
+  TEST_ASSERT_EQUAL(300, sampler.level(0));
+  TEST_ASSERT_EQUAL(-1, sampler.level(1));
+  TEST_ASSERT_EQUAL(600, sampler.level(2));
+  // one read and one multiplexer write per sample, after the first start
+  TEST_ASSERT_EQUAL(1 + 4 * 2, Adafruit_ADS1015::transactions);
+}
+
+void test_sampler_waits_for_interval() {
+  fakehal::setTime(1767254400);
+  MoistureSampler sampler;
+  sampler.watch(1);
+  TEST_ASSERT_FALSE(sampler.handle());
+  fakehal::advanceMicros(sampler.sampleIntervalMs * 1000);
+  TEST_ASSERT_TRUE(sampler.handle());
+  TEST_ASSERT_EQUAL(1, sampler.samples);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_level_before_first_reading);
+  RUN_TEST(test_spike_is_ignored);
+  RUN_TEST(test_negative_reading_counts_as_zero);
+  RUN_TEST(test_sampler_cycles_watched_channels);
+  RUN_TEST(test_sampler_waits_for_interval);
+  return UNITY_END();
+}
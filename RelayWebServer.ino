@@ -22,8 +22,14 @@
 #define LED_PIN 5
 WS2812FX ws2812fx = WS2812FX(LED_COUNT, LED_PIN, NEO_RGB + NEO_KHZ800);
 
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_arena.h>
+
 #include <my_relay.h>
-Relay * LED_Switch = new Relay(4);
+Relay * LED_Switch = STATIC_NEW(Relay, 4);
 
 #ifdef ESP32
 WebServer server(80);
@@ -48,6 +54,14 @@ Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, APP_NAME,
 int debug = 0;
 char msg[40];
 
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase ledPhase("leds");
+
 void setup() {
   Serial.begin(115200);
   Serial.println("Booting up");
@@ -81,8 +95,11 @@ void setup() {
   server.on("/status", handleStatus);
   //TODO make the url thingy showable in status
   server.on("/ledswitch", handleLedStrip);
+  server.on("/metrics", handleMetrics);
   server.begin();
 
+  setupMetrics();
+
   LED_Switch->setup("ledswitch");
 
   ws2812fx.init();
@@ -203,8 +220,9 @@ void handleStatus() {
   JsonObject switches = doc.createNestedObject("switches");
 
   switches[LED_Switch->name]["state"] = LED_Switch->state();
-  switches[LED_Switch->name]["Last On Time"] = LED_Switch->prettyOnTime;
-  switches[LED_Switch->name]["Last Off Time"] = LED_Switch->prettyOffTime;
+  char buf[PRETTY_TIME_SIZE];
+  switches[LED_Switch->name]["Last On Time"] = LED_Switch->prettyOnTime(buf);
+  switches[LED_Switch->name]["Last Off Time"] = LED_Switch->prettyOffTime(buf);
   uint8_t mode = ws2812fx.getMode(); 
   switches[LED_Switch->name]["Mode"] = ws2812fx.getModeName(mode);
 
@@ -256,12 +274,36 @@ void handleLedStrip() {
   }
 }
 
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&ledPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
   ws2812fx.service();
+  loopTimer.lap(ledPhase);
 
   time_t now = time(nullptr);
 
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
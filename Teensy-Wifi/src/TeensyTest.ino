@@ -114,8 +114,9 @@ void handleStatus(WiFiClient& client) {
   JsonObject sensors = doc.createNestedObject("sensors");
 
   switches[Switch->name]["state"] = Switch->state();
-  switches[Switch->name]["Last On Time"] = Switch->prettyOnTime;
-  switches[Switch->name]["Last Off Time"] = Switch->prettyOffTime;
+  char buf[PRETTY_TIME_SIZE];
+  switches[Switch->name]["Last On Time"] = Switch->prettyOnTime(buf);
+  switches[Switch->name]["Last Off Time"] = Switch->prettyOffTime(buf);
   int lightLevel = 0;
   lightLevel = analogRead(A9);
   sensors["lightLevel"] = lightLevel;
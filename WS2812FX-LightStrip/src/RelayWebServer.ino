@@ -20,15 +20,21 @@
 #include <EEPROM.h>
 #define EEPROM_SIZE 4
 
+#include <my_jsonstream.h>
+#include <my_metrics.h>
+#include <my_looptimer.h>
+#include <my_heap.h>
+#include <my_arena.h>
+
 #include <Wire.h>
 
 #ifndef NOLCD
 #include <my_motion.h>
-MOTION * motion = new MOTION(MOTION_PIN); 
+MOTION * motion = STATIC_NEW(MOTION, MOTION_PIN);
 #include <my_lcd.h>
-LCD * lcd = new LCD();
+LCD * lcd = STATIC_NEW(LCD);
 #include <my_relay.h>
-Relay * LED_Switch = new Relay(RELAY_PIN);
+Relay * LED_Switch = STATIC_NEW(Relay, RELAY_PIN);
 #include <Versatile_RotaryEncoder.h>
 // Create a global pointer for the encoder object
 Versatile_RotaryEncoder *versatile_encoder;
@@ -78,6 +84,15 @@ Syslog syslog(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, APP_NAME,
 int debug = 0;
 char msg[40];
 
+MetricRegistry metrics;
+HeapMetrics heapMetrics;
+
+LoopTimer loopTimer;
+LoopPhase otaPhase("ota");
+LoopPhase httpPhase("http");
+LoopPhase ledPhase("leds");
+LoopPhase controlPhase("controls");
+
 
 using namespace std;
 
@@ -195,7 +210,7 @@ void setup() {
   lcd->setCursor(0, 0);
 
   // Rotary Encoder setup
-  versatile_encoder = new Versatile_RotaryEncoder(ROTENC_CLK, ROTENC_DT, ROTENC_SW);
+  versatile_encoder = STATIC_NEW(Versatile_RotaryEncoder, ROTENC_CLK, ROTENC_DT, ROTENC_SW);
   // Load to the encoder all nedded handle functions here (up to 9 functions)
   versatile_encoder->setHandleRotate(handleRotate);
   versatile_encoder->setHandlePressRotate(handlePressRotate);
@@ -224,8 +239,11 @@ void setup() {
   server.on("/colorSetByName", handleSetColorByName);
   server.on("/setBrightness", handlesetBrightness);
   server.on("/power", handlePower);
+  server.on("/metrics", handleMetrics);
   server.begin();
 
+  setupMetrics();
+
 
 
   // initialize the virtual strip as you would any normal ws2812fx instance
@@ -314,8 +332,9 @@ void handleStatus() {
 
 #ifndef NOLCD
   switches["ledstrip"]["state"] = LED_Switch->state();
-  switches["ledstrip"]["Last On Time"] = LED_Switch->prettyOnTime;
-  switches["ledstrip"]["Last Off Time"] = LED_Switch->prettyOffTime;
+  char buf[PRETTY_TIME_SIZE];
+  switches["ledstrip"]["Last On Time"] = LED_Switch->prettyOnTime(buf);
+  switches["ledstrip"]["Last Off Time"] = LED_Switch->prettyOffTime(buf);
 #endif
   uint8_t segment = *(ws2812fx.getActiveSegments());
   uint8_t mode = ws2812fx.getMode(segment); 
@@ -399,10 +418,7 @@ void setColor(bool byIteration) {
   if (byIteration) {
     led_colors[colorNumber].nextColor();
   } else {
-    char *color = new char[12];
-    strcpy(color,server.arg("color").c_str());
-
-    if (!led_colors[colorNumber].setColorByName(color)) {
+    if (!led_colors[colorNumber].setColorByName(server.arg("color").c_str())) {
       sprintf(msg, "ERROR: Color %s not found", server.arg("color"));
       server.send(404, "text/plain", msg);
       return;
@@ -554,12 +570,33 @@ uint8_t switchModeWithSegment(int direction) {
 
 
 bool activity = false;
+void setupMetrics() {
+  heapMetrics.addTo(metrics);
+
+  loopTimer.add(&otaPhase);
+  loopTimer.add(&httpPhase);
+  loopTimer.add(&ledPhase);
+  loopTimer.add(&controlPhase);
+  loopTimer.addTo(metrics);
+}
+
+void handleMetrics() {
+  ChunkedResponse<decltype(server)> response(server);
+  response.begin(200, PROMETHEUS_CONTENT_TYPE);
+  metrics.writePrometheus(response);
+  response.end();
+}
+
 void loop() {
+  loopTimer.begin();
   ArduinoOTA.handle();
+  loopTimer.lap(otaPhase);
   server.handleClient();
+  loopTimer.lap(httpPhase);
 
   time_t now = time(nullptr);
   ws2812fx.service();
+  loopTimer.lap(ledPhase);
 
 #ifndef NOLCD
   if (encoderActivityTime + 100 < millis() && ledState == 1) {
@@ -591,7 +628,12 @@ void loop() {
     syslog.log(LOG_INFO, "Olivia left cubby, turned her LED lights off");
   }
 #endif
+  loopTimer.lap(controlPhase);
 
+  if (loopTimer.end()) {
+    syslog.logf(LOG_WARNING, "Loop stalled for %lums, slowest phase %s took %lums",
+                loopTimer.stallLoopMicros / 1000, loopTimer.stallPhase->labelValue, loopTimer.stallPhaseMicros / 1000);
+  }
 }
 
 #ifndef NOLCD
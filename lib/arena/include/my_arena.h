@@ -0,0 +1,55 @@
+#ifndef MY_ARENA_H
+#define MY_ARENA_H
+#include <Arduino.h>
+#include <new>
+#include <utility>
+
+#ifndef NAME_POOL_SIZE
+#define NAME_POOL_SIZE 256         // bytes for every device name, with their '\0'
+#endif
+
+// Copies of device names in one fixed buffer instead of a new char[] each.
+// Names are set once in setup() and kept for the life of the sketch, so
+// nothing is ever freed; the same name asked for twice is stored once.
+//
+//   name = names.intern(a);
+//
+// A name that doesn't fit is copied to the heap as before and counted in
+// spilled, so a pool sized too small still works and shows up in the
+// metrics.
+class NamePool {
+  public:
+    uint16_t used = 0;
+    uint16_t spilled = 0;
+
+    const char* intern(const char* a);
+
+  private:
+    char bytes[NAME_POOL_SIZE] = {};
+};
+
+extern NamePool names;
+
+// Room for one T in static storage, built when make() is called. Only the
+// first make() of a slot should ever run; the object is never destroyed.
+template <class T>
+class StaticSlot {
+  public:
+    template <class... A>
+    T* make(A&&... a) { return new (storage) T(std::forward<A>(a)...); }
+
+  private:
+    alignas(T) uint8_t storage[sizeof(T)];
+};
+
+// Where a sketch would write new T(...) for an object it keeps forever,
+// without the heap: each place in the code gets a slot of its own, sized
+// by the compiler, so running out shows up when linking instead of as a
+// fragmented heap after weeks of uptime.
+//
+//   MOTION * motion = STATIC_NEW(MOTION, D7);
+//
+// The arguments can't name locals of the enclosing function.
+#define STATIC_NEW(T, ...) ([]() { static StaticSlot<T> slot; return slot.make(__VA_ARGS__); }())
+
+#endif
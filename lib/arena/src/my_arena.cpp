@@ -0,0 +1,22 @@
+#include "my_arena.h"
+
+NamePool names;
+
+const char* NamePool::intern(const char* a) {
+  for (uint16_t i = 0; i < used; i += strlen(bytes + i) + 1) {
+    if (strcmp(bytes + i, a) == 0) return bytes + i;
+  }
+
+  size_t length = strlen(a) + 1;
+  if (length > (size_t) (NAME_POOL_SIZE - used)) {
+    spilled++;
+    char* copy = new char[length];
+    strcpy(copy, a);
+    return copy;
+  }
+
+  char* copy = bytes + used;
+  memcpy(copy, a, length);
+  used += length;
+  return copy;
+}
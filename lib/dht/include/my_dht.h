@@ -1,28 +1,39 @@
 #ifndef MYDHT_H
 #define MYDHT_H
 
-#include <DHT_U.h>
+#include <time.h>
+#include <DHT.h>
 
-class myDHT : public DHT_Unified {
+// A DHT22 sample is one bit-banged transfer of about 5ms with interrupts
+// off. handle() does that transfer once per interval and fills both
+// temperature and humidity from it, and setSlot() offsets sensors that
+// share a loop so their transfers land on different passes.
+class myDHT : public DHT {
   uint8_t pin;
   uint8_t type;
+  unsigned long nextSampleMs = 0;
 
   public:
     //variables
-    char* sensorName;
-    sensors_event_t event;
-    double humid;
-    double temp;
+    const char* sensorName;
+    double humid = -1;
+    double temp = -1;
+    time_t sampleTime = 0;           // when humid and temp were read
+    unsigned long sampleMs = 0;
+    unsigned long failures = 0;
+    // the DHT22 can't be read more often than every 2s
+    unsigned long intervalMs = 2000;
 
     //constructors
-    //myDHT(uint8_t x, uint8_t y) : DHT_Unified(x, y);
     myDHT(uint8_t x, uint8_t y);
 
     void setSensorName(const char* a);
+    // sample in slot a of b evenly spaced slots per interval
+    void setSlot(uint8_t a, uint8_t b);
     double getHumidity();
     double getTemp();
+    // true when a new sample was taken
     bool handle();
 };
 
 #endif
-
@@ -1,7 +1,8 @@
 #include "my_dht.h"
+#include <my_arena.h>
 
 //constructors
-myDHT::myDHT(uint8_t x, uint8_t y) : DHT_Unified(x, y) {
+myDHT::myDHT(uint8_t x, uint8_t y) : DHT(x, y) {
   pin = x;
   type = y;
   pinMode(pin, INPUT_PULLUP);
@@ -9,8 +10,11 @@ myDHT::myDHT(uint8_t x, uint8_t y) : DHT_Unified(x, y) {
 
 //member functions
 void myDHT::setSensorName(const char* a) {
-  sensorName = new char[strlen(a)+1];
-  strcpy(sensorName,a);
+  sensorName = names.intern(a);
+}
+
+void myDHT::setSlot(uint8_t a, uint8_t b) {
+  nextSampleMs = millis() + intervalMs * a / (b ? b : 1);
 }
 
 double myDHT::getHumidity() {
@@ -22,11 +26,24 @@ double myDHT::getTemp() {
 }
 
 bool myDHT::handle() {
-  this->humidity().getEvent(&event);
-  humid = isnan(event.relative_humidity) ? -1 : event.relative_humidity;
+  unsigned long ms = millis();
+  if ((long) (ms - nextSampleMs) < 0) return false;
+
+  // keep the slot; start over from now if the loop fell a whole interval behind
+  nextSampleMs += intervalMs;
+  if ((long) (ms - nextSampleMs) >= 0) nextSampleMs = ms + intervalMs;
 
-  this->temperature().getEvent(&event);
-  temp = isnan(event.temperature) ? -1 : event.temperature * 9 / 5 + 32;
+  // the one transfer; the reads below come from the driver's copy of it
+  if (read(true)) {
+    humid = readHumidity();
+    temp = readTemperature(true);
+  } else {
+    humid = -1;
+    temp = -1;
+    failures++;
+  }
+  sampleTime = time(nullptr);
+  sampleMs = ms;
 
   return true;
 }
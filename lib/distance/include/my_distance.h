@@ -1,30 +1,55 @@
 #ifndef MYDISTANCE_H
 #define MYDISTANCE_H
-#include <time.h>                       // time() ctime()
-#include <sys/time.h>                   // struct timeval
-#include <coredecls.h>                  // settimeofday_cb()
-#include <TZ.h>
-#include <Wire.h>
-#include "Adafruit_MCP23X17.h"
+#include <Arduino.h>
+#include <my_inputs.h>
 
 //HC-SR04
- 
-// Can't use MCP b/c it doesn't support pulseIn
+//
+// handle() never waits for the echo. It sends a ping every pingIntervalMs
+// and picks up the echo on a later call from the times an interrupt stamped
+// on its rising and falling edges. The distance is the median of the last few
+// readings, so a stray echo doesn't show up.
+//
+// The echo has to be on a native pin that can interrupt: any ESP8266 GPIO
+// but GPIO16, any ESP32 GPIO. An MCP23X17 pin can't time it, since its
+// edges only reach the loop after an I2C read, and a millisecond there is
+// 17cm. On a pin without capture (or a Teensy) setup() returns false and
+// handle() falls back to pulseIn() with a timeout short enough not to stall
+// the loop. The trigger can be any native output.
 class DISTANCE {
+  static const uint8_t READINGS = 5;
+  // no echo by then means nothing in range (about 4m)
+  static const unsigned long ECHO_TIMEOUT_US = 25000;
+
   int echoPin;
   int trigPin;
-  Adafruit_MCP23X17* mcp;
-  bool i2cPins = false;
-  time_t now, prevTime = 0;
+  unsigned long lastPingMs = 0;
+  bool capture = false;
+  bool pinging = false;
+  unsigned long pingUs = 0;
+  unsigned long riseUs = 0;
+  bool rose = false;
+  EdgeRing echoEdges;
+  long readings[READINGS];
+  uint8_t readingCount = 0;
+  uint8_t nextReading = 0;
+
+  void ping();
+  void addReading(unsigned long echoUs);
 
   public:
-    long inches;
-    char* name;
+    long inches = 0;        // median of the recent readings
+    long lastInches = 0;    // the latest reading on its own
+    unsigned long timeouts = 0;
+    unsigned long pingIntervalMs = 1000;
+    const char* name;
 
     //constructor
     DISTANCE (int a, int b );
 
-    void setup(const char* a);
+    // false when the echo pin can't be timed by interrupt
+    bool setup(const char* a);
     void handle();
+    long median();
 };
 #endif
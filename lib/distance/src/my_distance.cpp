@@ -1,26 +1,85 @@
 #include "my_distance.h"
+#include <my_arena.h>
 
 DISTANCE::DISTANCE (int a, int b ): echoPin(a), trigPin(b) {}
 
-void DISTANCE::setup(const char* a) {
-  name = new char[strlen(a)+1];
-  strcpy(name,a);
+bool DISTANCE::setup(const char* a) {
+  name = names.intern(a);
 
   pinMode(trigPin, OUTPUT);
+  digitalWrite(trigPin, LOW);
   pinMode(echoPin, INPUT);
-}
-
-void DISTANCE::handle() {
-  prevTime = now;
-  now = time(nullptr);
 
-  if ( now == prevTime ) return;
+  capture = attachEdgeInterrupt(echoPin, &echoEdges);
+  return capture;
+}
 
-  digitalWrite(trigPin, LOW);
-  delayMicroseconds(2);
+void DISTANCE::ping() {
+  // the 10us trigger is the only busy wait left
   digitalWrite(trigPin, HIGH);
   delayMicroseconds(10);
   digitalWrite(trigPin, LOW);
+  pingUs = micros();
+}
+
+void DISTANCE::addReading(unsigned long echoUs) {
+  lastInches = echoUs / 74 / 2;
+  readings[nextReading] = lastInches;
+  nextReading = (nextReading + 1) % READINGS;
+  if (readingCount < READINGS) readingCount++;
+  inches = median();
+}
+
+long DISTANCE::median() {
+  if (readingCount == 0) return 0;
+
+  long sorted[READINGS];
+  for (uint8_t i = 0; i < readingCount; i++) {
+    long v = readings[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  return sorted[readingCount / 2];
+}
+
+void DISTANCE::handle() {
+  if (pinging) {
+    InputEdge edge;
+    while (echoEdges.pop(edge)) {
+      if (edge.level == HIGH) {
+        riseUs = edge.micros;
+        rose = true;
+      } else if (rose) {
+        addReading(edge.micros - riseUs);
+        pinging = false;
+        break;
+      }
+    }
+    if (pinging && micros() - pingUs > ECHO_TIMEOUT_US) {
+      timeouts++;
+      pinging = false;
+    }
+  }
+
+  if ( pinging || millis() - lastPingMs < pingIntervalMs ) return;
+  lastPingMs = millis();
+
+  if (!capture) {
+    ping();
+    unsigned long echoUs = pulseIn(echoPin, HIGH, ECHO_TIMEOUT_US);
+    if (echoUs) {
+      addReading(echoUs);
+    } else {
+      timeouts++;
+    }
+    return;
+  }
 
-  inches = pulseIn(echoPin, HIGH) / 74 / 2;
+  // edges left over from a timed out ping would pair up with this one
+  InputEdge stale;
+  while (echoEdges.pop(stale)) {}
+  rose = false;
+  pinging = true;
+  ping();
 }
@@ -0,0 +1,32 @@
+#ifndef MY_HEAP_H
+#define MY_HEAP_H
+#include <Arduino.h>
+#include <my_metrics.h>
+#include <my_arena.h>
+
+// The free heap, how broken up it is and the largest block it can still
+// hand out, read from the core when /metrics is scraped. A heap that keeps
+// enough bytes free but loses its large blocks is fragmenting, and the next
+// big String or TLS buffer is the one that fails.
+//
+//   heapMetrics.addTo(metrics);
+//
+// The name pool from my_arena.h comes with them: its bytes in use and the
+// names that spilled to the heap. The ESP32 core doesn't report
+// fragmentation, so there that gauge stays out of the registry, and a host
+// build gets only the name pool.
+class HeapMetrics {
+  public:
+    Gauge freeGauge;
+    Gauge fragmentationGauge;
+    Gauge maxBlockGauge;
+    Gauge namePoolGauge;
+    Counter namePoolSpillCounter;
+
+    //constructor
+    HeapMetrics();
+
+    void addTo(MetricRegistry& metrics);
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "my_heap.h"
+
+HeapMetrics::HeapMetrics():
+  freeGauge("heap_free_bytes", "Free heap."),
+  fragmentationGauge("heap_fragmentation_percent", "0 when the free heap is one block, near 100 when it is all small pieces."),
+  maxBlockGauge("heap_max_block_bytes", "The largest block the heap can hand out."),
+  namePoolGauge("name_pool_used_bytes", "Device name bytes in the static pool."),
+  namePoolSpillCounter("name_pool_spilled_total", "Device names that didn't fit the pool and went to the heap.") {}
+
+void HeapMetrics::addTo(MetricRegistry& metrics) {
+#if defined(ESP8266)
+  freeGauge.setSource([](void*) { return (double) ESP.getFreeHeap(); });
+  metrics.add(&freeGauge);
+  fragmentationGauge.setSource([](void*) { return (double) ESP.getHeapFragmentation(); });
+  metrics.add(&fragmentationGauge);
+  maxBlockGauge.setSource([](void*) { return (double) ESP.getMaxFreeBlockSize(); });
+  metrics.add(&maxBlockGauge);
+#elif defined(ESP32)
+  freeGauge.setSource([](void*) { return (double) ESP.getFreeHeap(); });
+  metrics.add(&freeGauge);
+  maxBlockGauge.setSource([](void*) { return (double) ESP.getMaxAllocHeap(); });
+  metrics.add(&maxBlockGauge);
+#endif
+  namePoolGauge.setSource([](void*) { return (double) names.used; });
+  metrics.add(&namePoolGauge);
+  namePoolSpillCounter.setSource([](void*) { return (double) names.spilled; });
+  metrics.add(&namePoolSpillCounter);
+}
@@ -0,0 +1,98 @@
+#ifndef MY_I2CBUS_H
+#define MY_I2CBUS_H
+#include <Arduino.h>
+#include <Wire.h>
+
+#ifndef I2C_BUS_MAX_DEVICES
+#define I2C_BUS_MAX_DEVICES 8
+#endif
+
+// Speeds from the datasheets, for addDevice()
+#define I2C_STANDARD_MODE 100000UL     // AM2315, PCF8574 LCD backpacks
+#define I2C_FAST_MODE     400000UL     // VEML7700, SSD1306, and the cap here
+#define I2C_MCP23X17_MAX  1700000UL
+#define I2C_ADS1015_MAX   3400000UL
+
+// what the work passed to I2CBus::call() reports
+enum I2CResult {
+  I2C_IDLE = 0,     // nothing was due, the bus wasn't touched
+  I2C_DONE = 1,
+  I2C_FAILED = 2
+};
+
+// The one Wire bus a sketch shares between its drivers. It brings the bus up
+// on the sketch's pins, unsticks it first if a device was reset mid byte, and
+// runs it as fast as the slowest registered device allows, up to 400kHz.
+//
+// Every transaction already happens one at a time from loop(), so instead of
+// a queue the sketch runs its bus work through call(). call() times each
+// piece of work against the device's address and counts failures, and it
+// recovers the bus when SDA or SCL is found held low afterwards. scan()
+// walks the address space a few addresses per handle() so a health check
+// never holds up the loop.
+class I2CBus {
+  public:
+    struct Device {
+      uint8_t address = 0;
+      bool present = false;       // answered the last scan or probe
+      uint32_t maxClock = 0;      // 0 for one only seen by a scan
+      unsigned long ops = 0;
+      unsigned long errors = 0;
+      unsigned long totalMicros = 0;
+      unsigned long maxMicros = 0;
+    };
+
+  private:
+    int sdaPin = -1;
+    int sclPin = -1;
+    Device devices[I2C_BUS_MAX_DEVICES];
+    uint8_t scanNext = 128;       // 128 when no scan is running
+
+    Device* find(uint8_t address, bool add);
+    void applyClock();
+
+  public:
+    uint8_t deviceCount = 0;
+    uint32_t clock = I2C_STANDARD_MODE;
+    unsigned long recoveries = 0;
+    unsigned long scans = 0;
+    uint8_t scanFound = 0;        // devices answering the last finished scan
+
+    bool begin(int sda, int scl);
+    // a device on the bus and the fastest clock it takes
+    void addDevice(uint8_t address, uint32_t maxClock);
+    // false if SDA or SCL is being held low
+    bool lineIdle();
+    // clock out whatever a device is still sending, then STOP; true once
+    // the bus is idle again
+    bool recover();
+    // address only write, counted like any other transaction
+    bool probe(uint8_t address);
+    void record(uint8_t address, unsigned long startMicros, bool ok);
+
+    // run op, which returns an I2CResult, as a timed transaction on
+    // address; false if it failed
+    template <class Op>
+    bool call(uint8_t address, Op op) {
+      unsigned long start = micros();
+      I2CResult result = op();
+      if (!lineIdle()) {
+        result = I2C_FAILED;
+        recover();
+      }
+      if (result != I2C_IDLE) record(address, start, result == I2C_DONE);
+      return result != I2C_FAILED;
+    }
+
+    void scan();
+    // abandons a running scan: scanFound keeps what it found so far, and
+    // the partial scan isn't counted in scans
+    void stopScan();
+    bool scanning();
+    // from the loop: advances a scan
+    void handle();
+
+    const Device& device(uint8_t i);
+};
+
+#endif
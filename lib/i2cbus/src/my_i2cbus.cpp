@@ -0,0 +1,144 @@
+#include "my_i2cbus.h"
+
+// addresses probed per handle() while scanning
+static const uint8_t SCAN_STEP = 8;
+
+bool I2CBus::begin(int sda, int scl) {
+  sdaPin = sda;
+  sclPin = scl;
+
+  bool ok = recover();
+  Wire.begin(sda, scl);
+  applyClock();
+  return ok;
+}
+
+void I2CBus::addDevice(uint8_t address, uint32_t maxClock) {
+  Device* d = find(address, true);
+  if (d == nullptr) return;
+  (*d).maxClock = maxClock;
+  applyClock();
+}
+
+void I2CBus::applyClock() {
+  uint32_t fastest = I2C_FAST_MODE;
+  bool any = false;
+  for (uint8_t i = 0; i < deviceCount; i++) {
+    if (devices[i].maxClock == 0) continue;
+    any = true;
+    if (devices[i].maxClock < fastest) fastest = devices[i].maxClock;
+  }
+  // nothing registered, stay at the speed everything takes
+  clock = any ? fastest : I2C_STANDARD_MODE;
+  if (sdaPin >= 0) Wire.setClock(clock);
+}
+
+I2CBus::Device* I2CBus::find(uint8_t address, bool add) {
+  for (uint8_t i = 0; i < deviceCount; i++) {
+    if (devices[i].address == address) return &devices[i];
+  }
+  if (!add || deviceCount == I2C_BUS_MAX_DEVICES) return nullptr;
+
+  Device& d = devices[deviceCount++];
+  d.address = address;
+  return &d;
+}
+
+bool I2CBus::lineIdle() {
+  if (sdaPin < 0) return true;
+  return digitalRead(sdaPin) == HIGH && digitalRead(sclPin) == HIGH;
+}
+
+bool I2CBus::recover() {
+  if (sdaPin < 0) return false;
+
+  pinMode(sdaPin, INPUT_PULLUP);
+  pinMode(sclPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+  if (lineIdle()) return true;
+
+  recoveries++;
+  // a device part way through a byte lets go of SDA within nine clocks;
+  // the lines are driven open drain, low or released to the pull-up
+  for (uint8_t i = 0; i < 9 && digitalRead(sdaPin) == LOW; i++) {
+    pinMode(sclPin, OUTPUT);
+    digitalWrite(sclPin, LOW);
+    delayMicroseconds(5);
+    pinMode(sclPin, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+
+  // STOP: SDA rises while SCL is high
+  pinMode(sdaPin, OUTPUT);
+  digitalWrite(sdaPin, LOW);
+  delayMicroseconds(5);
+  pinMode(sdaPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+
+  bool idle = lineIdle();
+  // hand the pins back to Wire
+  Wire.begin(sdaPin, sclPin);
+  Wire.setClock(clock);
+  return idle;
+}
+
+bool I2CBus::probe(uint8_t address) {
+  return call(address, [address]() {
+    Wire.beginTransmission(address);
+    return Wire.endTransmission() == 0 ? I2C_DONE : I2C_FAILED;
+  });
+}
+
+void I2CBus::record(uint8_t address, unsigned long startMicros, bool ok) {
+  unsigned long took = micros() - startMicros;
+
+  Device* d = find(address, true);
+  if (d == nullptr) return;
+  (*d).ops++;
+  (*d).totalMicros += took;
+  if (took > (*d).maxMicros) (*d).maxMicros = took;
+  if (ok) {
+    (*d).present = true;
+  } else {
+    (*d).errors++;
+  }
+}
+
+void I2CBus::scan() {
+  if (scanning()) return;
+  scanNext = 1;
+  scanFound = 0;
+}
+
+void I2CBus::stopScan() {
+  scanNext = 128;
+}
+
+bool I2CBus::scanning() {
+  return scanNext < 128;
+}
+
+void I2CBus::handle() {
+  if (!scanning()) return;
+
+  for (uint8_t n = 0; n < SCAN_STEP && scanNext < 128; n++, scanNext++) {
+    // don't give an empty address a table entry just for not answering
+    Device* d = find(scanNext, false);
+    if (d == nullptr) {
+      Wire.beginTransmission(scanNext);
+      if (Wire.endTransmission() != 0) continue;
+      d = find(scanNext, true);
+      if (d == nullptr) continue;
+      (*d).present = true;
+      scanFound++;
+      continue;
+    }
+    (*d).present = false;
+    if (probe(scanNext)) scanFound++;
+  }
+  if (!scanning()) scans++;
+}
+
+const I2CBus::Device& I2CBus::device(uint8_t i) {
+  return devices[i < deviceCount ? i : 0];
+}
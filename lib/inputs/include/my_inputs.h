@@ -0,0 +1,76 @@
+#ifndef MY_INPUTS_H
+#define MY_INPUTS_H
+#include <Arduino.h>
+#include <Wire.h>
+#include "Adafruit_MCP23X17.h"
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+// Input edges caught by interrupts instead of polling digitalRead() every
+// pass through loop(). Each watched pin gets an EdgeRing that an interrupt
+// fills with timestamped levels and the sensor drains in its handle(), so a
+// pulse shorter than a loop pass still shows up.
+//
+//   native pin:  attachEdgeInterrupt(pin, &ring);
+//   MCP23X17:    mcpInterrupts.begin(&mcp, INT_PIN);    // INTA/INTB mirrored
+//                mcpInterrupts.watch(pin, &ring);
+//                mcpInterrupts.poll();                  // in loop()
+
+struct InputEdge {
+  uint8_t level;
+  unsigned long micros;
+};
+
+// Single producer, single consumer: the producer is an interrupt handler
+// (or McpInterrupts::poll()) and the consumer is the sensor that owns the
+// ring. Each side only writes its own index, and the ESPs and Teensys store
+// a byte in one instruction, so neither side needs a lock.
+class EdgeRing {
+  static const uint8_t SIZE = 8;     // a power of two
+  InputEdge edges[SIZE];
+  volatile uint8_t head = 0;         // written by the producer
+  volatile uint8_t tail = 0;         // written by the consumer
+
+  public:
+    // edges lost because the ring was full (a bouncing contact); the last
+    // level always survives
+    volatile unsigned long dropped = 0;
+
+    bool push(uint8_t level, unsigned long micros);
+    bool pop(InputEdge& edge);
+    bool empty();
+};
+
+// CHANGE interrupt on a native pin feeding ring. Returns false for a pin
+// without interrupt support (GPIO16 on an ESP8266) and on a Teensy, and the
+// caller keeps polling.
+bool attachEdgeInterrupt(uint8_t pin, EdgeRing* ring);
+void detachEdgeInterrupt(uint8_t pin);
+
+// The MCP23X17 latches which pins changed and their levels in INTF and
+// INTCAP and pulls INTA/INTB low. The interrupt handler only notes the time,
+// since the bus can't be used from an interrupt, and poll() reads the
+// capture and hands each changed pin's edge to its ring.
+class McpInterrupts {
+  Adafruit_MCP23X17* mcp = nullptr;
+  EdgeRing* rings[16] = {};
+  uint16_t watched = 0;
+  uint16_t levels = 0;
+  volatile bool pending = false;
+  volatile unsigned long pendingMicros = 0;
+
+  static void onInterrupt(void* arg);
+
+  public:
+    unsigned long polls = 0;
+
+    // intPin is the native pin INTA and INTB are wired to
+    bool begin(Adafruit_MCP23X17* a, uint8_t intPin);
+    bool watch(uint8_t pin, EdgeRing* ring);
+    // once per loop; only touches the bus after an interrupt
+    void poll();
+};
+
+#endif
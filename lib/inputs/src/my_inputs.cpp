@@ -0,0 +1,128 @@
+#include "my_inputs.h"
+
+bool IRAM_ATTR EdgeRing::push(uint8_t level, unsigned long micros) {
+  uint8_t next = (head + 1) & (SIZE - 1);
+  if (next == tail) {
+    // full: the newest edge replaces the last one queued so the ring still
+    // ends on the pin's current level. The consumer is somewhere behind,
+    // reading a different slot.
+    uint8_t last = (head - 1) & (SIZE - 1);
+    edges[last].level = level;
+    edges[last].micros = micros;
+    dropped++;
+    return false;
+  }
+  edges[head].level = level;
+  edges[head].micros = micros;
+  head = next;
+  return true;
+}
+
+bool EdgeRing::pop(InputEdge& edge) {
+  if (tail == head) return false;
+  edge = edges[tail];
+  tail = (tail + 1) & (SIZE - 1);
+  return true;
+}
+
+bool EdgeRing::empty() {
+  return tail == head;
+}
+
+static EdgeRing* nativeRings[NUM_DIGITAL_PINS];
+
+// the pin rides along as the interrupt argument, so one handler serves
+// every pin
+static void IRAM_ATTR onNativePin(void* arg) {
+  uint8_t pin = (uintptr_t) arg;
+  nativeRings[pin]->push(digitalRead(pin), micros());
+}
+
+bool attachEdgeInterrupt(uint8_t pin, EdgeRing* ring) {
+#ifdef TEENSYDUINO
+  // no interrupt argument in the Teensy core, keep polling
+  (void) pin; (void) ring;
+  return false;
+#else
+  if (pin >= NUM_DIGITAL_PINS || digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT) return false;
+
+  nativeRings[pin] = ring;
+  attachInterruptArg(digitalPinToInterrupt(pin), onNativePin, (void*) (uintptr_t) pin, CHANGE);
+  return true;
+#endif
+}
+
+void detachEdgeInterrupt(uint8_t pin) {
+#ifndef TEENSYDUINO
+  if (pin >= NUM_DIGITAL_PINS || digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT) return;
+
+  detachInterrupt(digitalPinToInterrupt(pin));
+  nativeRings[pin] = nullptr;
+#endif
+}
+
+void IRAM_ATTR McpInterrupts::onInterrupt(void* arg) {
+  McpInterrupts* self = (McpInterrupts*) arg;
+  // keep the first time; later changes are in the same capture
+  if (!self->pending) {
+    self->pendingMicros = micros();
+    self->pending = true;
+  }
+}
+
+bool McpInterrupts::begin(Adafruit_MCP23X17* a, uint8_t intPin) {
+#ifdef TEENSYDUINO
+  (void) a; (void) intPin;
+  return false;
+#else
+  if (digitalPinToInterrupt(intPin) == NOT_AN_INTERRUPT) return false;
+
+  mcp = a;
+  // INTA and INTB mirrored, push-pull, active low
+  (*mcp).setupInterrupts(true, false, LOW);
+  levels = (*mcp).readGPIOAB();
+
+  pinMode(intPin, INPUT_PULLUP);
+  attachInterruptArg(digitalPinToInterrupt(intPin), onInterrupt, this, FALLING);
+  return true;
+#endif
+}
+
+bool McpInterrupts::watch(uint8_t pin, EdgeRing* ring) {
+  if (mcp == nullptr || pin >= 16) return false;
+
+  rings[pin] = ring;
+  watched |= 1u << pin;
+  (*mcp).setupInterruptPin(pin, CHANGE);
+  levels = (*mcp).readGPIOAB();
+  return true;
+}
+
+void McpInterrupts::poll() {
+  if (!pending) return;
+
+  noInterrupts();
+  unsigned long when = pendingMicros;
+  pending = false;
+  interrupts();
+  polls++;
+
+  // INTCAP holds the levels at the interrupt; reading it releases INT.
+  // A pin that has moved again since then gets a second edge timed now.
+  uint16_t captured = (*mcp).getCapturedInterrupt();
+  uint16_t current = (*mcp).readGPIOAB();
+  unsigned long now = micros();
+
+  for (uint8_t pin = 0; pin < 16; pin++) {
+    uint16_t bit = 1u << pin;
+    if (!(watched & bit)) continue;
+
+    if ((captured ^ levels) & bit) {
+      rings[pin]->push((captured & bit) ? HIGH : LOW, when);
+    }
+    if ((current ^ captured) & bit) {
+      rings[pin]->push((current & bit) ? HIGH : LOW, now);
+    }
+  }
+  levels = current;
+}
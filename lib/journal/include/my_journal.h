@@ -0,0 +1,95 @@
+#ifndef MY_JOURNAL_H
+#define MY_JOURNAL_H
+#include <Arduino.h>
+#include <time.h>
+#include <my_jsonstream.h>
+
+#ifndef JOURNAL_SLOTS
+#define JOURNAL_SLOTS 64           // 12 bytes each
+#endif
+#ifndef JOURNAL_MAX_SOURCES
+#define JOURNAL_MAX_SOURCES 16
+#endif
+#ifndef JOURNAL_PAGE
+#define JOURNAL_PAGE 32            // most events in one response
+#endif
+
+enum EventType : uint8_t {
+  EVENT_BOOT = 0,
+  EVENT_ON,                        // value: seconds it is set to run
+  EVENT_OFF,
+  EVENT_OPEN,
+  EVENT_OPENING,
+  EVENT_CLOSED,
+  EVENT_CLOSING,
+  EVENT_ACTIVE,                    // a schedule allowed to run again, value:
+                                   // the reading that did it
+  EVENT_INACTIVE,
+  EVENT_SENSOR_FAILED,
+  EVENT_SENSOR_OK,
+  EVENT_TYPES
+};
+
+const char* eventTypeName(uint8_t type);
+
+// What happened on the device, kept in RAM where a lost UDP packet can't
+// take it: a fixed ring of small binary records, each with a sequence
+// number that only goes up. A poller asks for the events after the last
+// sequence number it saw and gets just those, so after a WiFi dropout it
+// catches up without scraping /status.
+//
+// The sequence numbers start over at every boot, so the response carries
+// the boot id the sketch gave begin(). A poller keeps it with the last
+// sequence number it saw and asks again from since=0 when it changes; the
+// numbers alone can't tell a restart that has logged more events than
+// since from the same boot.
+//
+//   journal.begin(ESP.random());
+//   journal.record(SYSTEM_APPNAME, EVENT_BOOT);
+//   ...
+//   journal.record(relay->name, relay->on ? EVENT_ON : EVENT_OFF, relay->runTime);
+//   ...
+//   journal.writeJson(json, strtoul(server.arg("since").c_str(), nullptr, 10));
+//
+// Sources are names that outlive the journal, like a relay's name; each
+// one is stored once and the records carry its index.
+class EventJournal {
+  public:
+    struct Record {
+      uint32_t seq;
+      uint32_t time;               // time() when it was recorded
+      uint8_t source;
+      uint8_t type;
+      int16_t value;               // what it means depends on the type
+    };
+
+    // different at every boot, from ESP.random() or the like
+    uint32_t boot = 0;
+
+    void begin(uint32_t a);
+    // the new record's sequence number
+    uint32_t record(const char* source, EventType type, int16_t value = 0);
+
+    // the oldest and newest sequence numbers still held, 0 when empty
+    uint32_t firstSeq();
+    uint32_t lastSeq() { return nextSeq - 1; }
+    // false once seq has been overwritten or not been recorded yet
+    bool get(uint32_t seq, Record& r);
+    const char* sourceName(uint8_t id);
+
+    // the boot id, first, last, how many after since were lost to the ring,
+    // and up to limit events after since, oldest first. A since past last
+    // can only be from an earlier boot, and the events start over from the
+    // oldest; a poller still has to compare boot to catch the rest.
+    void writeJson(JsonStream& json, uint32_t since, uint8_t limit = JOURNAL_PAGE);
+
+  private:
+    Record records[JOURNAL_SLOTS];
+    uint32_t nextSeq = 1;
+    const char* sources[JOURNAL_MAX_SOURCES];
+    uint8_t sourceCount = 0;
+
+    uint8_t sourceId(const char* name);
+};
+
+#endif
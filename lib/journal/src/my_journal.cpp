@@ -0,0 +1,81 @@
+#include "my_journal.h"
+
+static const char* const EVENT_TYPE_NAMES[EVENT_TYPES] = {
+  "boot", "on", "off", "open", "opening", "closed", "closing",
+  "active", "inactive", "sensor failed", "sensor ok"
+};
+
+const char* eventTypeName(uint8_t type) {
+  return type < EVENT_TYPES ? EVENT_TYPE_NAMES[type] : "unknown";
+}
+
+uint8_t EventJournal::sourceId(const char* name) {
+  for (uint8_t i = 0; i < sourceCount; i++) {
+    if (sources[i] == name || strcmp(sources[i], name) == 0) return i;
+  }
+  if (sourceCount == JOURNAL_MAX_SOURCES) return 0xFF;
+  sources[sourceCount] = name;
+  return sourceCount++;
+}
+
+const char* EventJournal::sourceName(uint8_t id) {
+  return id < sourceCount ? sources[id] : "unknown";
+}
+
+void EventJournal::begin(uint32_t a) {
+  boot = a;
+}
+
+uint32_t EventJournal::record(const char* source, EventType type, int16_t value) {
+  Record& r = records[(nextSeq - 1) % JOURNAL_SLOTS];
+  r.seq = nextSeq;
+  r.time = (uint32_t) time(nullptr);
+  r.source = sourceId(source);
+  r.type = type;
+  r.value = value;
+  return nextSeq++;
+}
+
+uint32_t EventJournal::firstSeq() {
+  if (nextSeq == 1) return 0;
+  return nextSeq > JOURNAL_SLOTS ? nextSeq - JOURNAL_SLOTS : 1;
+}
+
+bool EventJournal::get(uint32_t seq, Record& r) {
+  if (seq == 0 || seq >= nextSeq || seq < firstSeq()) return false;
+  r = records[(seq - 1) % JOURNAL_SLOTS];
+  return true;
+}
+
+void EventJournal::writeJson(JsonStream& json, uint32_t since, uint8_t limit) {
+  uint32_t first = firstSeq();
+  uint32_t last = lastSeq();
+  if (since > last) since = 0;
+
+  uint32_t seq = since + 1;
+  uint32_t lost = 0;
+  if (first > 0 && seq < first) {
+    lost = first - seq;
+    seq = first;
+  }
+
+  json.add("boot", boot);
+  json.add("first", first);
+  json.add("last", last);
+  json.add("lost", lost);
+
+  json.beginArray("events");
+  Record r;
+  uint8_t n = 0;
+  for (; n < limit && get(seq, r); n++, seq++) {
+    json.beginObject();
+    json.add("seq", r.seq);
+    json.add("time", r.time);
+    json.add("source", sourceName(r.source));
+    json.add("event", eventTypeName(r.type));
+    json.add("value", (int) r.value);
+    json.endObject();
+  }
+  json.endArray();
+  json.add("more", seq <= last);
+}
@@ -0,0 +1,138 @@
+#ifndef MY_JSONSTREAM_H
+#define MY_JSONSTREAM_H
+#include <Arduino.h>
+
+#ifndef JSON_CHUNK_SIZE
+#define JSON_CHUNK_SIZE 512       // one chunk fits a 536 byte TCP segment
+#endif
+
+// the same value both web servers use, for when this is included first
+#ifndef CONTENT_LENGTH_UNKNOWN
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+#endif
+
+// Writes JSON to a Print as it is generated, so a handler never holds the
+// whole document. Nothing is built first and nothing is measured, which means
+// there is no document size to outgrow: a response is as long as the fields
+// written into it. Commas, quoting and escaping are handled here, and pretty
+// mode lays the output out like serializeJsonPretty() did.
+//
+//   json.beginObject();
+//   json.beginObject("switches");
+//   json.add("state", relay->state());
+//   json.endObject();
+//   json.add("debug", debug);
+//   json.endObject();
+//
+// Objects and arrays nest up to JSON_STREAM_DEPTH - 1 deep.
+class JsonStream {
+  public:
+    static const uint8_t JSON_STREAM_DEPTH = 16;
+
+    Print& out;
+    bool pretty;
+    uint8_t decimals = 2;         // digits after the point for floats
+
+    //constructor
+    JsonStream(Print& a, bool b = true): out(a), pretty(b) {}
+
+    JsonStream& beginObject();
+    JsonStream& beginObject(const char* name);
+    JsonStream& endObject();
+    JsonStream& beginArray();
+    JsonStream& beginArray(const char* name);
+    JsonStream& endArray();
+
+    // the member name, the value has to follow
+    JsonStream& key(const char* name);
+
+    // a value, either after key() or as the next array element
+    JsonStream& value(const char* a);
+    JsonStream& value(bool a);
+    JsonStream& value(int a) { return writeInteger(a < 0, a < 0 ? 0ULL - a : a); }
+    JsonStream& value(unsigned int a) { return writeInteger(false, a); }
+    JsonStream& value(long a) { return writeInteger(a < 0, a < 0 ? 0ULL - a : a); }
+    JsonStream& value(unsigned long a) { return writeInteger(false, a); }
+    JsonStream& value(long long a) { return writeInteger(a < 0, a < 0 ? 0ULL - a : a); }
+    JsonStream& value(unsigned long long a) { return writeInteger(false, a); }
+    JsonStream& value(double a);
+
+    template <typename T>
+    JsonStream& add(const char* name, T a) { key(name); return value(a); }
+
+  private:
+    uint8_t depth = 0;
+    uint16_t empty = 0;           // bit n set while level n has no members
+    bool afterKey = false;
+
+    void separate();
+    void newline(uint8_t level);
+    JsonStream& open(char c);
+    JsonStream& close(char c);
+    void writeString(const char* a);
+    JsonStream& writeInteger(bool negative, unsigned long long a);
+};
+
+// A Print that sends what is written to it as HTTP chunks. begin() sends the
+// headers straight away with no Content-Length, and every JSON_CHUNK_SIZE
+// bytes go out with sendContent(), so the only buffer is the one chunk.
+// end() sends what is left and the closing empty chunk. Works with
+// ESP8266WebServer and the ESP32 WebServer.
+//
+//   ChunkedResponse<ESP8266WebServer> response(server);
+//   response.begin(200, "text/plain");
+//   JsonStream json(response);
+//   ...
+//   response.end();
+template <class Server>
+class ChunkedResponse : public Print {
+  public:
+    Server& server;
+    size_t sent = 0;              // body bytes handed to the server
+
+    //constructor
+    ChunkedResponse(Server& a): server(a) {}
+
+    void begin(int code, const char* contentType) {
+      server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+      server.send(code, contentType, "");
+    }
+
+    size_t write(uint8_t c) override {
+      buffer[length++] = c;
+      if (length == JSON_CHUNK_SIZE) sendChunk();
+      return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t n = size;
+      while (size > 0) {
+        size_t room = JSON_CHUNK_SIZE - length;
+        size_t part = size < room ? size : room;
+        memcpy(buffer + length, data, part);
+        length += part;
+        data += part;
+        size -= part;
+        if (length == JSON_CHUNK_SIZE) sendChunk();
+      }
+      return n;
+    }
+
+    void end() {
+      sendChunk();
+      server.sendContent("");
+    }
+
+  private:
+    char buffer[JSON_CHUNK_SIZE];
+    size_t length = 0;
+
+    void sendChunk() {
+      if (length == 0) return;
+      server.sendContent(buffer, length);
+      sent += length;
+      length = 0;
+    }
+};
+
+#endif
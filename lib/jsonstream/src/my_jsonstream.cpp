@@ -0,0 +1,159 @@
+#include "my_jsonstream.h"
+
+JsonStream& JsonStream::beginObject() {
+  return open('{');
+}
+
+JsonStream& JsonStream::beginObject(const char* name) {
+  key(name);
+  return open('{');
+}
+
+JsonStream& JsonStream::endObject() {
+  return close('}');
+}
+
+JsonStream& JsonStream::beginArray() {
+  return open('[');
+}
+
+JsonStream& JsonStream::beginArray(const char* name) {
+  key(name);
+  return open('[');
+}
+
+JsonStream& JsonStream::endArray() {
+  return close(']');
+}
+
+JsonStream& JsonStream::key(const char* name) {
+  separate();
+  writeString(name);
+  out.print(pretty ? ": " : ":");
+  afterKey = true;
+  return *this;
+}
+
+JsonStream& JsonStream::value(const char* a) {
+  separate();
+  if (a == nullptr) {
+    out.print("null");
+  } else {
+    writeString(a);
+  }
+  return *this;
+}
+
+JsonStream& JsonStream::value(bool a) {
+  separate();
+  out.print(a ? "true" : "false");
+  return *this;
+}
+
+// JSON has no NaN, a DHT that has never answered shows up as null
+JsonStream& JsonStream::value(double a) {
+  separate();
+  if (isnan(a) || isinf(a)) {
+    out.print("null");
+    return *this;
+  }
+
+  char buf[32];
+  int n = snprintf(buf, sizeof(buf), "%.*f", decimals, a);
+  if (n <= 0 || n >= (int) sizeof(buf)) {
+    out.print("null");
+    return *this;
+  }
+  // 21.50 -> 21.5 and 3.00 -> 3
+  if (strchr(buf, '.')) {
+    while (buf[n - 1] == '0') buf[--n] = '\0';
+    if (buf[n - 1] == '.') buf[--n] = '\0';
+  }
+  out.write((const uint8_t*) buf, n);
+  return *this;
+}
+
+// the comma and line break before a member or element, nothing after a key
+void JsonStream::separate() {
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+  if (depth == 0) return;
+
+  uint16_t bit = 1 << (depth < JSON_STREAM_DEPTH ? depth : JSON_STREAM_DEPTH - 1);
+  if (empty & bit) {
+    empty &= ~bit;
+  } else {
+    out.write(',');
+  }
+  newline(depth);
+}
+
+void JsonStream::newline(uint8_t level) {
+  if (!pretty) return;
+  out.print("\r\n");
+  for (uint8_t i = 0; i < level; i++) out.print("  ");
+}
+
+JsonStream& JsonStream::open(char c) {
+  separate();
+  out.write(c);
+  depth++;
+  if (depth < JSON_STREAM_DEPTH) empty |= 1 << depth;
+  return *this;
+}
+
+JsonStream& JsonStream::close(char c) {
+  if (depth == 0) return *this;
+
+  uint16_t bit = 1 << (depth < JSON_STREAM_DEPTH ? depth : JSON_STREAM_DEPTH - 1);
+  bool wasEmpty = empty & bit;
+  empty &= ~bit;
+  depth--;
+  if (!wasEmpty) newline(depth);
+  out.write(c);
+  return *this;
+}
+
+void JsonStream::writeString(const char* a) {
+  out.write('"');
+  const char* run = a;
+  for (const char* p = a; *p; p++) {
+    char c = *p;
+    if (c != '"' && c != '\\' && (uint8_t) c >= 0x20) continue;
+
+    // copy the plain stretch in one write, then the escape
+    if (p > run) out.write((const uint8_t*) run, p - run);
+    run = p + 1;
+    char esc[7] = { '\\', c, 0 };
+    switch (c) {
+      case '\n': esc[1] = 'n'; break;
+      case '\r': esc[1] = 'r'; break;
+      case '\t': esc[1] = 't'; break;
+      case '\b': esc[1] = 'b'; break;
+      case '\f': esc[1] = 'f'; break;
+      case '"':
+      case '\\': break;
+      default: snprintf(esc, sizeof(esc), "\\u%04x", (uint8_t) c);
+    }
+    out.print(esc);
+  }
+  const char* end = run + strlen(run);
+  if (end > run) out.write((const uint8_t*) run, end - run);
+  out.write('"');
+}
+
+JsonStream& JsonStream::writeInteger(bool negative, unsigned long long a) {
+  separate();
+  char buf[21];
+  char* p = buf + sizeof(buf);
+  *--p = '\0';
+  do {
+    *--p = '0' + a % 10;
+    a /= 10;
+  } while (a > 0);
+  if (negative) *--p = '-';
+  out.print(p);
+  return *this;
+}
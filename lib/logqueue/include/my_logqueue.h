@@ -0,0 +1,80 @@
+#ifndef MY_LOGQUEUE_H
+#define MY_LOGQUEUE_H
+#include <Arduino.h>
+#include <Syslog.h>
+#include <stdarg.h>
+
+#ifndef LOG_QUEUE_SLOTS
+#define LOG_QUEUE_SLOTS 12
+#endif
+#ifndef LOG_MESSAGE_SIZE
+#define LOG_MESSAGE_SIZE 160       // longer ones are cut short and counted
+#endif
+
+// Sits in front of a Syslog and takes its place in a sketch: log() and
+// logf() only format the message into a fixed ring of slots tagged with
+// its app name and priority, and handle() sends at most one UDP packet per
+// call from wherever loop() has time to spare. Relays and handlers never
+// wait on WiFi to log.
+//
+// A message identical to the one still waiting behind it is folded into
+// it and sent once with a repeat count. No more than budgetPerSecond go
+// out in any second, and when the ring is full new messages are dropped,
+// counted, and reported in a warning of their own once there is room.
+//
+//   Syslog syslogUdp(udpClient, SYSLOG_SERVER, SYSLOG_PORT, DEVICE_HOSTNAME, APP, LOG_LOCAL0);
+//   LogQueue syslog(syslogUdp, APP);
+class LogQueue {
+  public:
+    struct Entry {
+      const char* app;
+      uint16_t pri;
+      uint16_t repeats;            // identical messages folded into this one
+      char text[LOG_MESSAGE_SIZE];
+    };
+
+    uint8_t budgetPerSecond = 5;
+    unsigned long queued = 0;
+    unsigned long sent = 0;
+    unsigned long coalesced = 0;
+    unsigned long dropped = 0;
+    unsigned long truncated = 0;   // cut short to fit a slot
+    unsigned long failed = 0;      // sends the UDP stack refused, retried later
+
+    //constructor
+    LogQueue(Syslog& a, const char* b);
+
+    // the app name for the messages that follow, like Syslog::appName()
+    LogQueue& appName(const char* a);
+
+    bool log(uint16_t pri, const char* message);
+    bool log(uint16_t pri, const String& message);
+    bool logf(uint16_t pri, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+    // tagged with app just for this message
+    bool log(const char* app, uint16_t pri, const char* message);
+    bool log(const char* app, uint16_t pri, const String& message);
+    bool logf(const char* app, uint16_t pri, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+
+    // sends the oldest message if the budget allows, true if one went out
+    bool handle();
+    // sends everything now, ignoring the budget
+    void flush();
+    uint8_t pending() { return count; }
+
+  private:
+    Syslog& syslog;
+    const char* defaultApp;
+    const char* currentApp;
+    Entry entries[LOG_QUEUE_SLOTS];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    unsigned long windowMs = 0;
+    uint8_t windowSent = 0;
+    unsigned long droppedReported = 0;
+
+    bool enqueue(const char* app, uint16_t pri, const char* text);
+    bool vlogf(const char* app, uint16_t pri, const char* fmt, va_list args);
+    bool send();
+};
+
+#endif
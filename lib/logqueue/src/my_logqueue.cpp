@@ -0,0 +1,130 @@
+#include "my_logqueue.h"
+
+LogQueue::LogQueue(Syslog& a, const char* b): syslog(a), defaultApp(b), currentApp(b) {}
+
+LogQueue& LogQueue::appName(const char* a) {
+  currentApp = a;
+  return *this;
+}
+
+bool LogQueue::log(uint16_t pri, const char* message) {
+  return enqueue(currentApp, pri, message);
+}
+
+bool LogQueue::log(uint16_t pri, const String& message) {
+  return enqueue(currentApp, pri, message.c_str());
+}
+
+bool LogQueue::log(const char* app, uint16_t pri, const char* message) {
+  return enqueue(app, pri, message);
+}
+
+bool LogQueue::log(const char* app, uint16_t pri, const String& message) {
+  return enqueue(app, pri, message.c_str());
+}
+
+bool LogQueue::logf(uint16_t pri, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  bool queuedOk = vlogf(currentApp, pri, fmt, args);
+  va_end(args);
+  return queuedOk;
+}
+
+bool LogQueue::logf(const char* app, uint16_t pri, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  bool queuedOk = vlogf(app, pri, fmt, args);
+  va_end(args);
+  return queuedOk;
+}
+
+bool LogQueue::vlogf(const char* app, uint16_t pri, const char* fmt, va_list args) {
+  char text[LOG_MESSAGE_SIZE];
+  if (vsnprintf(text, sizeof(text), fmt, args) >= (int) sizeof(text)) truncated++;
+  return enqueue(app, pri, text);
+}
+
+bool LogQueue::enqueue(const char* app, uint16_t pri, const char* text) {
+  if (strnlen(text, LOG_MESSAGE_SIZE) == LOG_MESSAGE_SIZE) truncated++;
+
+  // the same line again before the last one went out
+  if (count > 0) {
+    Entry& newest = entries[(head + count - 1) % LOG_QUEUE_SLOTS];
+    if (newest.app == app && newest.pri == pri && newest.repeats < 0xFFFF &&
+        strncmp(newest.text, text, LOG_MESSAGE_SIZE - 1) == 0) {
+      newest.repeats++;
+      coalesced++;
+      return true;
+    }
+  }
+
+  if (count == LOG_QUEUE_SLOTS) {
+    dropped++;
+    return false;
+  }
+
+  Entry& e = entries[(head + count) % LOG_QUEUE_SLOTS];
+  e.app = app;
+  e.pri = pri;
+  e.repeats = 0;
+  strncpy(e.text, text, LOG_MESSAGE_SIZE - 1);
+  e.text[LOG_MESSAGE_SIZE - 1] = '\0';
+  count++;
+  queued++;
+  return true;
+}
+
+bool LogQueue::handle() {
+  if (count == 0) return false;
+
+  unsigned long now = millis();
+  if (now - windowMs >= 1000) {
+    windowMs = now;
+    windowSent = 0;
+  }
+  if (windowSent >= budgetPerSecond) return false;
+
+  windowSent++;
+  return send();
+}
+
+void LogQueue::flush() {
+  while (count > 0 && send());
+}
+
+// the oldest message, or first a note of how many were dropped since the
+// last note
+bool LogQueue::send() {
+  Entry& e = entries[head];
+  unsigned long lost = dropped - droppedReported;
+
+  bool ok;
+  if (lost > 0) {
+    ok = syslog.logf(LOG_WARNING, "log queue full, %lu messages dropped", lost);
+  } else {
+    syslog.appName(e.app);
+    if (e.repeats > 0) {
+      ok = syslog.logf(e.pri, "%s [x%u]", e.text, (unsigned) e.repeats + 1);
+    } else {
+      ok = syslog.log(e.pri, e.text);
+    }
+    syslog.appName(defaultApp);
+  }
+
+  if (!ok) {
+    // no WiFi or no buffer, leave it for the next second
+    failed++;
+    windowSent = budgetPerSecond;
+    return false;
+  }
+
+  sent++;
+  if (lost > 0) {
+    droppedReported = dropped;
+  } else {
+    head = (head + 1) % LOG_QUEUE_SLOTS;
+    count--;
+  }
+  return true;
+}
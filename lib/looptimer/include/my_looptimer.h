@@ -0,0 +1,88 @@
+#ifndef MY_LOOPTIMER_H
+#define MY_LOOPTIMER_H
+#include <Arduino.h>
+#include <my_metrics.h>
+#include <my_jsonstream.h>
+
+#define LOOP_BUCKETS 14
+#ifndef LOOP_MAX_PHASES
+#define LOOP_MAX_PHASES 8
+#endif
+
+// 50us up to 1s, shared by the loop and every phase
+extern const float LOOP_BUCKETS_US[LOOP_BUCKETS];
+
+// One part of loop(), like server.handleClient() or the relay handling. All
+// the phases are one histogram family, told apart by their phase label.
+class LoopPhase : public BucketHistogram<LOOP_BUCKETS> {
+  public:
+    unsigned long lastMicros = 0;  // in the most recent pass
+
+    //constructor
+    LoopPhase(const char* a);
+};
+
+// Times every pass of loop() and the phases in it with micros(), into
+// fixed histograms that give the max and p99 of each. A pass that runs past
+// stallMicros is a stall: end() returns true and the slowest phase of that
+// pass is kept, so the sketch can log what was blocking.
+//
+//   loopTimer.begin();
+//   ArduinoOTA.handle();
+//   loopTimer.lap(otaPhase);
+//   server.handleClient();
+//   loopTimer.lap(httpPhase);
+//   if (loopTimer.end()) { log loopTimer.stallPhase->labelValue }
+//
+// A pass runs from the end of the last one, so the core's own work between
+// passes, the WiFi stack on an ESP8266, is in it too as the "core" phase.
+class LoopTimer {
+  public:
+    BucketHistogram<LOOP_BUCKETS> loops;
+    LoopPhase core;
+    Counter stallCounter;
+
+    unsigned long stallMicros = 100000;
+    unsigned long stalls = 0;
+    // the most recent stall
+    unsigned long stallLoopMicros = 0;
+    LoopPhase* stallPhase = nullptr;
+    unsigned long stallPhaseMicros = 0;
+    unsigned long stallMs = 0;     // millis() when it happened
+
+    //constructor
+    LoopTimer();
+
+    void add(LoopPhase* phase);
+    // registers the loop, the phases and the stall count
+    void addTo(MetricRegistry& metrics);
+
+    void begin();
+    // charges the time since begin() or the last lap() to phase
+    void lap(LoopPhase& phase);
+    // true when this pass stalled
+    bool end();
+    // after end(): delay(ms) without charging it to the next pass, so a
+    // sketch resting between passes doesn't fill the loop histogram
+    void idle(unsigned long ms);
+
+    // count, avg, p99 and max for the loop and each phase, and the last stall
+    void writeJson(JsonStream& json);
+    // starts the histograms and their max values over; stalls is scraped
+    // as a counter and keeps counting
+    void reset();
+
+  private:
+    LoopPhase* phases[LOOP_MAX_PHASES];
+    uint8_t phaseCount = 0;
+    unsigned long passStart = 0;
+    unsigned long mark = 0;
+    unsigned long lastEnd = 0;
+    bool ended = false;
+    LoopPhase* slowest = nullptr;
+
+    void charge(LoopPhase& phase, unsigned long now);
+    void writeHistogram(JsonStream& json, const char* name, Histogram& h);
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "my_looptimer.h"
+
+const float LOOP_BUCKETS_US[LOOP_BUCKETS] = {
+  50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+LoopPhase::LoopPhase(const char* a):
+  BucketHistogram<LOOP_BUCKETS>("loop_phase_microseconds", "Time spent in each part of loop().", LOOP_BUCKETS_US) {
+  setLabel("phase", a);
+}
+
+LoopTimer::LoopTimer():
+  loops("loop_microseconds", "Time for one pass of loop().", LOOP_BUCKETS_US),
+  core("core"),
+  stallCounter("loop_stalls_total", "Passes of loop() longer than the stall limit.") {
+}
+
+void LoopTimer::add(LoopPhase* phase) {
+  if (phaseCount < LOOP_MAX_PHASES) phases[phaseCount++] = phase;
+}
+
+void LoopTimer::addTo(MetricRegistry& metrics) {
+  metrics.add(&loops);
+  metrics.add(&core);
+  for (uint8_t i = 0; i < phaseCount; i++) metrics.add(phases[i]);
+  stallCounter.setSource([](void* t) { return (double) static_cast<LoopTimer*>(t)->stalls; }, this);
+  metrics.add(&stallCounter);
+}
+
+void LoopTimer::begin() {
+  unsigned long now = micros();
+  slowest = nullptr;
+  if (ended) {
+    passStart = lastEnd;
+    mark = lastEnd;
+    charge(core, now);
+  } else {
+    passStart = now;
+    mark = now;
+  }
+}
+
+void LoopTimer::lap(LoopPhase& phase) {
+  charge(phase, micros());
+}
+
+void LoopTimer::charge(LoopPhase& phase, unsigned long now) {
+  unsigned long elapsed = now - mark;
+  mark = now;
+  phase.lastMicros = elapsed;
+  phase.observe(elapsed);
+  if (slowest == nullptr || elapsed > slowest->lastMicros) slowest = &phase;
+}
+
+bool LoopTimer::end() {
+  unsigned long now = micros();
+  unsigned long elapsed = now - passStart;
+  loops.observe(elapsed);
+  lastEnd = now;
+  ended = true;
+
+  if (elapsed <= stallMicros) return false;
+  stalls++;
+  stallLoopMicros = elapsed;
+  stallPhase = slowest;
+  stallPhaseMicros = slowest ? slowest->lastMicros : 0;
+  stallMs = millis();
+  return true;
+}
+
+void LoopTimer::idle(unsigned long ms) {
+  delay(ms);
+  if (ended) lastEnd = micros();
+}
+
+void LoopTimer::reset() {
+  loops.reset();
+  core.reset();
+  for (uint8_t i = 0; i < phaseCount; i++) phases[i]->reset();
+}
+
+void LoopTimer::writeHistogram(JsonStream& json, const char* name, Histogram& h) {
+  json.beginObject(name);
+  json.add("count", h.count);
+  json.add("avg (us)", h.count ? (unsigned long) (h.sum / h.count) : 0UL);
+  json.add("p99 (us)", (unsigned long) h.quantile(0.99));
+  json.add("max (us)", (unsigned long) h.maxValue);
+  json.endObject();
+}
+
+void LoopTimer::writeJson(JsonStream& json) {
+  writeHistogram(json, "loop", loops);
+
+  json.beginObject("phases");
+  writeHistogram(json, core.labelValue, core);
+  for (uint8_t i = 0; i < phaseCount; i++) {
+    writeHistogram(json, phases[i]->labelValue, *phases[i]);
+  }
+  json.endObject();
+
+  json.add("stall limit (us)", stallMicros);
+  json.add("stalls", stalls);
+  if (stallPhase) {
+    json.beginObject("last stall");
+    json.add("loop (us)", stallLoopMicros);
+    json.add("phase", stallPhase->labelValue);
+    json.add("phase (us)", stallPhaseMicros);
+    json.add("age (s)", (millis() - stallMs) / 1000);
+    json.endObject();
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef MY_MCP_H
+#define MY_MCP_H
+#include <Wire.h>
+#include "Adafruit_MCP23X17.h"
+
+// Shadow registers for an MCP23X17 shared by several relays and sensors.
+//
+// The Adafruit driver does a read-modify-write of OLAT for every
+// digitalWrite() and a bus read for every digitalRead(). McpPort keeps a copy
+// of the 16 bit output latch instead: writes only change the copy and sync()
+// sends it in a single writeGPIOAB() once per loop. Reads come from one
+// readGPIOAB() taken the first time a pin is read after each sync().
+//
+//   Adafruit_MCP23X17 mcp;
+//   McpPort mcpPort(&mcp);
+//   ...
+//   mcp.begin_I2C(); mcpPort.begin();   // in setup()
+//   mcpPort.sync();                     // at the end of loop()
+class McpPort {
+  Adafruit_MCP23X17* mcp;
+  uint16_t olat = 0;        // what the outputs should be driving
+  uint16_t outputs = 0;     // pins set to OUTPUT
+  uint16_t levels = 0;      // pin levels from the last readGPIOAB()
+  bool dirty = false;
+  bool stale = true;
+
+  public:
+    unsigned long busReads = 0;
+    unsigned long busWrites = 0;
+
+    //constructor
+    McpPort(Adafruit_MCP23X17* a);
+
+    void begin();
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t val);
+    int digitalRead(uint8_t pin);
+
+    // send pending writes now, for pulses that can't wait for sync();
+    // true if there were any
+    bool flush();
+    // once per loop: flush writes and let the next read fetch fresh levels
+    bool sync();
+};
+
+#endif
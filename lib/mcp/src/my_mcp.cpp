@@ -0,0 +1,61 @@
+#include "my_mcp.h"
+
+//constructor
+McpPort::McpPort(Adafruit_MCP23X17* a): mcp(a) {}
+
+void McpPort::begin() {
+  // outputs read back what their latch is driving, so start from that
+  levels = (*mcp).readGPIOAB();
+  busReads++;
+  olat = levels;
+  stale = false;
+}
+
+void McpPort::pinMode(uint8_t pin, uint8_t mode) {
+  uint16_t bit = 1u << pin;
+  if (mode == OUTPUT) {
+    // get the latch right before the pin starts driving it
+    flush();
+    outputs |= bit;
+  } else {
+    outputs &= ~bit;
+  }
+  (*mcp).pinMode(pin, mode);
+}
+
+void McpPort::digitalWrite(uint8_t pin, uint8_t val) {
+  uint16_t bit = 1u << pin;
+  uint16_t next = (val == LOW) ? (olat & ~bit) : (olat | bit);
+  if (next != olat) {
+    olat = next;
+    dirty = true;
+  }
+}
+
+int McpPort::digitalRead(uint8_t pin) {
+  uint16_t bit = 1u << pin;
+  if (outputs & bit) {
+    return (olat & bit) ? HIGH : LOW;
+  }
+
+  if (stale) {
+    levels = (*mcp).readGPIOAB();
+    busReads++;
+    stale = false;
+  }
+  return (levels & bit) ? HIGH : LOW;
+}
+
+bool McpPort::flush() {
+  if (!dirty) return false;
+
+  (*mcp).writeGPIOAB(olat);
+  busWrites++;
+  dirty = false;
+  return true;
+}
+
+bool McpPort::sync() {
+  stale = true;
+  return flush();
+}
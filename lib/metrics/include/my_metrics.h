@@ -0,0 +1,116 @@
+#ifndef MY_METRICS_H
+#define MY_METRICS_H
+#include <Arduino.h>
+
+// Counters, gauges and histograms that a sketch keeps as globals next to
+// what they measure, and a registry that writes them all out in the
+// Prometheus text format. Nothing here allocates: each metric links itself
+// into the registry, and writePrometheus() prints straight to a Print, so
+// a ChunkedResponse from my_jsonstream.h serves them without a buffer.
+//
+//   Counter doorOperations("garage_door_operations_total", "Button presses.");
+//   metrics.add(&doorOperations);
+//   ...
+//   doorOperations.inc();
+//
+// Each metric can carry one label, for when several share a name, like one
+// gauge per irrigation zone. They are written as one family, under a single
+// HELP and TYPE, however far apart they were registered. Labels that never
+// change, like type="humidity", can be written ahead of it from labels.
+class Metric {
+  public:
+    enum Type : uint8_t { COUNTER, GAUGE, HISTOGRAM };
+
+    Type type;
+    const char* name;
+    const char* help;
+    const char* labelName = nullptr;
+    const char* labelValue = nullptr;
+    // written as they are, after the registry's and before the label
+    const char* labels = nullptr;
+    // for a counter or gauge whose value lives somewhere else, read at scrape
+    double (*read)(void* context) = nullptr;
+    void* context = nullptr;
+    Metric* next = nullptr;
+
+    //constructor
+    Metric(Type a, const char* b = nullptr, const char* c = nullptr): type(a), name(b), help(c) {}
+
+    void setup(const char* a, const char* b);
+    void setLabel(const char* a, const char* b);
+    void setSource(double (*a)(void*), void* b = nullptr);
+};
+
+class Counter : public Metric {
+  public:
+    unsigned long value = 0;
+
+    //constructor
+    Counter(const char* a = nullptr, const char* b = nullptr): Metric(COUNTER, a, b) {}
+
+    void inc(unsigned long n = 1) { value += n; }
+};
+
+class Gauge : public Metric {
+  public:
+    double value = 0;
+
+    //constructor
+    Gauge(const char* a = nullptr, const char* b = nullptr): Metric(GAUGE, a, b) {}
+
+    void set(double a) { value = a; }
+};
+
+// Fixed buckets, set by an ascending array of upper bounds that has to
+// outlive the histogram. counts holds one more than the bounds for the
+// observations above the last one; BucketHistogram<N> brings its own.
+class Histogram : public Metric {
+  public:
+    const float* bounds;
+    uint8_t buckets;
+    unsigned long* counts;         // per bucket, not cumulative
+    double sum = 0;
+    unsigned long count = 0;
+    float maxValue = 0;            // kept here, Prometheus has no place for it
+
+    //constructor
+    Histogram(const char* a, const char* b, const float* c, uint8_t d, unsigned long* e):
+      Metric(HISTOGRAM, a, b), bounds(c), buckets(d), counts(e) {}
+
+    void observe(float v);
+    // estimated from the buckets, like histogram_quantile() does
+    float quantile(float q);
+    void reset();
+};
+
+template <uint8_t N>
+class BucketHistogram : public Histogram {
+  public:
+    unsigned long storage[N + 1] = {};
+
+    //constructor
+    BucketHistogram(const char* a, const char* b, const float (&c)[N]):
+      Histogram(a, b, c, N, storage) {}
+};
+
+class MetricRegistry {
+  public:
+    // written into every sample, like "device=\"iot-shed\""
+    const char* labels = nullptr;
+    unsigned long scrapes = 0;
+
+    void add(Metric* m);
+    void writePrometheus(Print& out);
+
+  private:
+    Metric* head = nullptr;
+    Metric* tail = nullptr;
+
+    void writeFamily(Print& out, Metric* first);
+    void writeSample(Print& out, Metric* m, const char* suffix, const char* le, double value);
+};
+
+// what a scrape should be served as
+#define PROMETHEUS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+#endif
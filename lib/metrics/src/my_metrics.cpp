@@ -0,0 +1,197 @@
+#include "my_metrics.h"
+
+void Metric::setup(const char* a, const char* b) {
+  name = a;
+  help = b;
+}
+
+void Metric::setLabel(const char* a, const char* b) {
+  labelName = a;
+  labelValue = b;
+}
+
+void Metric::setSource(double (*a)(void*), void* b) {
+  read = a;
+  context = b;
+}
+
+void Histogram::observe(float v) {
+  uint8_t i = 0;
+  while (i < buckets && v > bounds[i]) i++;
+  counts[i]++;
+  sum += v;
+  count++;
+  if (v > maxValue) maxValue = v;
+}
+
+// linear within the bucket holding the q'th observation, and never past the
+// largest one seen
+float Histogram::quantile(float q) {
+  if (count == 0) return 0;
+
+  float rank = q * count;
+  unsigned long cumulative = 0;
+  for (uint8_t i = 0; i <= buckets; i++) {
+    unsigned long before = cumulative;
+    cumulative += counts[i];
+    if (counts[i] == 0 || cumulative < rank) continue;
+    if (i == buckets) break;
+
+    float lower = i == 0 ? 0 : bounds[i - 1];
+    float v = lower + (bounds[i] - lower) * (rank - before) / counts[i];
+    return v < maxValue ? v : maxValue;
+  }
+  return maxValue;
+}
+
+void Histogram::reset() {
+  memset(counts, 0, (buckets + 1) * sizeof(counts[0]));
+  sum = 0;
+  count = 0;
+  maxValue = 0;
+}
+
+void MetricRegistry::add(Metric* m) {
+  // already in, relinking would cut the list short
+  if (m->next != nullptr || m == tail) return;
+
+  if (tail == nullptr) {
+    head = m;
+  } else {
+    tail->next = m;
+  }
+  tail = m;
+}
+
+// Prometheus wants a family's samples together, so the first metric of each
+// name writes every later one with that name as well
+void MetricRegistry::writePrometheus(Print& out) {
+  scrapes++;
+  for (Metric* m = head; m != nullptr; m = m->next) {
+    bool written = false;
+    for (Metric* p = head; p != m; p = p->next) {
+      if (strcmp(p->name, m->name) == 0) {
+        written = true;
+        break;
+      }
+    }
+    if (!written) writeFamily(out, m);
+  }
+}
+
+static void writeEscaped(Print& out, const char* a, bool quotes) {
+  for (const char* p = a; *p; p++) {
+    if (*p == '\\') {
+      out.print("\\\\");
+    } else if (*p == '\n') {
+      out.print("\\n");
+    } else if (*p == '"' && quotes) {
+      out.print("\\\"");
+    } else {
+      out.write((uint8_t) *p);
+    }
+  }
+}
+
+// whole numbers as they are, so a counter in the millions keeps every digit
+static void writeNumber(Print& out, double v) {
+  char buf[24];
+  if (isnan(v)) {
+    out.print("NaN");
+  } else if (isinf(v)) {
+    out.print(v > 0 ? "+Inf" : "-Inf");
+  } else if (fabs(v) < 1e15 && v == (double) (long long) v) {
+    snprintf(buf, sizeof(buf), "%.0f", v);
+    out.print(buf);
+  } else {
+    snprintf(buf, sizeof(buf), "%.9g", v);
+    out.print(buf);
+  }
+}
+
+void MetricRegistry::writeFamily(Print& out, Metric* first) {
+  static const char* const TYPES[] = { "counter", "gauge", "histogram" };
+
+  if (first->help) {
+    out.print("# HELP ");
+    out.print(first->name);
+    out.print(" ");
+    writeEscaped(out, first->help, false);
+    out.print("\n");
+  }
+  out.print("# TYPE ");
+  out.print(first->name);
+  out.print(" ");
+  out.print(TYPES[first->type]);
+  out.print("\n");
+
+  for (Metric* m = first; m != nullptr; m = m->next) {
+    if (m != first && strcmp(m->name, first->name) != 0) continue;
+
+    switch (m->type) {
+      case Metric::COUNTER: {
+        Counter* c = static_cast<Counter*>(m);
+        writeSample(out, m, "", nullptr, c->read ? c->read(c->context) : c->value);
+        break;
+      }
+      case Metric::GAUGE: {
+        Gauge* g = static_cast<Gauge*>(m);
+        writeSample(out, m, "", nullptr, g->read ? g->read(g->context) : g->value);
+        break;
+      }
+      case Metric::HISTOGRAM: {
+        Histogram* h = static_cast<Histogram*>(m);
+        unsigned long cumulative = 0;
+        char le[16];
+        for (uint8_t i = 0; i < h->buckets; i++) {
+          cumulative += h->counts[i];
+          snprintf(le, sizeof(le), "%.9g", h->bounds[i]);
+          writeSample(out, m, "_bucket", le, cumulative);
+        }
+        writeSample(out, m, "_bucket", "+Inf", h->count);
+        writeSample(out, m, "_sum", nullptr, h->sum);
+        writeSample(out, m, "_count", nullptr, h->count);
+        break;
+      }
+    }
+  }
+}
+
+void MetricRegistry::writeSample(Print& out, Metric* m, const char* suffix, const char* le, double value) {
+  out.print(m->name);
+  out.print(suffix);
+
+  bool label = m->labelName && m->labelValue;
+  if (labels || m->labels || label || le) {
+    const char* comma = "";
+    out.print("{");
+    if (labels) {
+      out.print(labels);
+      comma = ",";
+    }
+    if (m->labels) {
+      out.print(comma);
+      out.print(m->labels);
+      comma = ",";
+    }
+    if (label) {
+      out.print(comma);
+      out.print(m->labelName);
+      out.print("=\"");
+      writeEscaped(out, m->labelValue, true);
+      out.print("\"");
+      comma = ",";
+    }
+    if (le) {
+      out.print(comma);
+      out.print("le=\"");
+      out.print(le);
+      out.print("\"");
+    }
+    out.print("}");
+  }
+
+  out.print(" ");
+  writeNumber(out, value);
+  out.print("\n");
+}
@@ -0,0 +1,58 @@
+#ifndef MY_MOISTURE_H
+#define MY_MOISTURE_H
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_ADS1X15.h>
+
+// Soil moisture readings jump around by tens of counts, and one bad one used
+// to be enough to flip an IrrigationRelay to wet mid run. MoistureFilter
+// keeps the last few raw readings and smooths their median with an EMA, all
+// in integers.
+struct MoistureFilter {
+  static const uint8_t SIZE = 5;
+  static const uint8_t EMA_SHIFT = 2;    // each new median moves it 1/4 of the way
+
+  int16_t readings[SIZE];
+  uint8_t count = 0;
+  uint8_t next = 0;
+  int32_t ema = 0;                       // fixed point, << 4
+  bool seeded = false;
+
+  // a reading below 0, a single-ended ADS1015 just under GND, counts as 0
+  void add(int16_t raw);
+  int16_t median();
+  // -1 until the first reading
+  int level();
+};
+
+// One ADS1015 shared by every zone with a sensor on it. It runs in
+// continuous conversion mode on one channel at a time: handle() picks up the
+// finished conversion, files it with that channel's filter and moves the
+// multiplexer on to the next watched channel. That is one read and one
+// config write per sample, or just the read with a single channel, against
+// a write, a busy poll and a read for every single-shot conversion. Relays
+// read level() without touching the bus.
+class MoistureSampler {
+  Adafruit_ADS1015 ads;
+  MoistureFilter filters[4];
+  uint8_t watched = 0;          // bit n = channel n
+  uint8_t channel = 0;
+  bool running = false;
+  unsigned long stepMs = 0;
+
+  void start(uint8_t a);
+
+  public:
+    // one conversion collected per interval, cycling through the channels
+    unsigned long sampleIntervalMs = 500;
+    unsigned long samples = 0;
+
+    bool begin(uint8_t address = 0x48);
+    void watch(uint8_t a);
+    // from the loop; only touches the bus once an interval
+    bool handle();
+    // filtered raw counts for channel a, -1 until it has been read
+    int level(uint8_t a);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "my_moisture.h"
+
+static const uint16_t MUX_SINGLE[] = {
+  ADS1X15_REG_CONFIG_MUX_SINGLE_0, ADS1X15_REG_CONFIG_MUX_SINGLE_1,
+  ADS1X15_REG_CONFIG_MUX_SINGLE_2, ADS1X15_REG_CONFIG_MUX_SINGLE_3
+};
+
+void MoistureFilter::add(int16_t raw) {
+  readings[next] = raw < 0 ? 0 : raw;
+  next = (next + 1) % SIZE;
+  if (count < SIZE) count++;
+
+  int32_t m = (int32_t) median() << 4;
+  if (!seeded) {
+    ema = m;
+    seeded = true;
+  } else {
+    ema += (m - ema) >> EMA_SHIFT;
+  }
+}
+
+int16_t MoistureFilter::median() {
+  int16_t sorted[SIZE];
+  for (uint8_t i = 0; i < count; i++) {
+    int16_t v = readings[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  return sorted[count / 2];
+}
+
+int MoistureFilter::level() {
+  return seeded ? (int) ((ema + 8) >> 4) : -1;
+}
+
+bool MoistureSampler::begin(uint8_t address) {
+  return ads.begin(address);
+}
+
+void MoistureSampler::watch(uint8_t a) {
+  if (a > 3) return;
+  watched |= 1 << a;
+  if (!running) start(a);
+}
+
+void MoistureSampler::start(uint8_t a) {
+  channel = a;
+  ads.startADCReading(MUX_SINGLE[a], true);
+  running = true;
+  stepMs = millis();
+}
+
+bool MoistureSampler::handle() {
+  if (!running || millis() - stepMs < sampleIntervalMs) return false;
+
+  // the interval is far longer than a conversion, so this is a finished one
+  // from the current channel
+  filters[channel].add(ads.getLastConversionResults());
+  samples++;
+
+  uint8_t n = channel;
+  do {
+    n = (n + 1) & 3;
+  } while (!(watched & (1 << n)));
+
+  if (n != channel) {
+    start(n);
+  } else {
+    stepMs = millis();
+  }
+  return true;
+}
+
+int MoistureSampler::level(uint8_t a) {
+  return a > 3 ? -1 : filters[a].level();
+}
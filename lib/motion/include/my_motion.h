@@ -1,28 +1,37 @@
 #ifndef MYMOTION_H
 #define MYMOTION_H
 #include <Wire.h>
-#include "Adafruit_MCP23X17.h"
+#include <my_mcp.h>
+#include <my_inputs.h>
 
 // HC-SR501
 // RCWL-0516 https://github.com/jdesbonnet/RCWL-0516
 
 class MOTION {
   int pin;
-  Adafruit_MCP23X17* mcp;
+  McpPort* mcp;
   bool i2cPins = false;
   time_t activityTime, now, prevTime = 0;
+  EdgeRing edges;
+  bool edgeInput = false;
+  int level = LOW;
 
   public:
     bool motionState;
-    char* name;
+    const char* name;
     time_t onTime = 0;
     time_t offTime = 0;
     int TIME_TO_HOLD = 15;
 
     MOTION (int a );
-    MOTION (int a, Adafruit_MCP23X17* b);
+    MOTION (int a, McpPort* b);
 
     void setup(const char* a);
+    // after setup(): catch the sensor's pulses with interrupts, so one
+    // shorter than a loop pass still counts. A sensor on the expander needs
+    // the McpInterrupts its INT line is wired to. Returns false and keeps
+    // polling if the pin can't interrupt.
+    bool useInterrupts(McpInterrupts* a = nullptr);
     bool activity();
     bool handle();
 };
@@ -1,22 +1,34 @@
 #include "my_motion.h"
+#include <my_arena.h>
 
 // HC-SR501
 // RCWL-0516 https://github.com/jdesbonnet/RCWL-0516
 
 MOTION::MOTION (int a ): pin(a) {}
-MOTION::MOTION (int a, Adafruit_MCP23X17* b) {
+MOTION::MOTION (int a, McpPort* b) {
   pin = a;
   mcp = b;
   i2cPins = true;
 }
 
 void MOTION::setup(const char* a) {
-  name = new char[strlen(a)+1];
-  strcpy(name,a);
+  name = names.intern(a);
 
   i2cPins ? (*mcp).pinMode(pin, INPUT) : pinMode(pin, INPUT);
 }
 
+bool MOTION::useInterrupts(McpInterrupts* a) {
+  if (i2cPins) {
+    if (a == nullptr || !(*a).watch(pin, &edges)) return false;
+    level = (*mcp).digitalRead(pin);
+  } else {
+    if (!attachEdgeInterrupt(pin, &edges)) return false;
+    level = digitalRead(pin);
+  }
+  edgeInput = true;
+  return true;
+}
+
 bool MOTION::activity() {
   return motionState;
 }
@@ -26,7 +38,16 @@ bool MOTION::handle() {
   now = time(nullptr);
 
   int activity;
-  if ( i2cPins ) {
+  if (edgeInput) {
+    // any rising edge since the last call is activity, even if the pin has
+    // already dropped again
+    activity = level;
+    InputEdge edge;
+    while (edges.pop(edge)) {
+      level = edge.level;
+      if (level == HIGH) activity = HIGH;
+    }
+  } else if ( i2cPins ) {
     activity = (*mcp).digitalRead(pin);
   } else {
     activity = digitalRead(pin);  // read input value from the motion sensor
@@ -1,26 +1,35 @@
 #ifndef REED_H
 #define REED_H
 #include <Wire.h>
-#include "Adafruit_MCP23X17.h"
+#include <my_mcp.h>
+#include <my_inputs.h>
 
 class ReedSwitch {
   int pin;
-  Adafruit_MCP23X17* mcp;
+  McpPort* mcp;
   bool i2cPins = false;
   const int DOOR_OPEN = 1;
   const int DOOR_CLOSED = 1;
+  EdgeRing edges;
+  bool edgeInput = false;
 
   public:
     //variables
     int doorStatus;
-    char* name;
+    const char* name;
+    unsigned long changedMicros = 0;   // edge time of the last change, with interrupts
 
     //constructors
     ReedSwitch ();
     ReedSwitch(int a);
-    ReedSwitch(int a, Adafruit_MCP23X17* b);
+    ReedSwitch(int a, McpPort* b);
 
     void setup(const char* a);
+    // after setup(): follow the switch from interrupt edges instead of
+    // reading it every handle(). A switch on the expander needs the
+    // McpInterrupts its INT line is wired to. Returns false and keeps
+    // polling if the pin can't interrupt.
+    bool useInterrupts(McpInterrupts* a = nullptr);
     const char* state();
     int status();
     bool handle();
@@ -1,21 +1,37 @@
 #include "my_reed.h"
+#include <my_arena.h>
 
 //constructors
 ReedSwitch::ReedSwitch () { }
 ReedSwitch::ReedSwitch(int a) {
   pin = a;
 }
-ReedSwitch::ReedSwitch(int a, Adafruit_MCP23X17* b) {
+ReedSwitch::ReedSwitch(int a, McpPort* b) {
   pin = a;
   mcp = b;
   i2cPins = true;
 }
 
 void ReedSwitch::setup(const char* a) {
-  name = new char[strlen(a)+1];
-  strcpy(name,a);
+  name = names.intern(a);
 
-  pinMode(pin, INPUT_PULLUP);
+  if (i2cPins) {
+    (*mcp).pinMode(pin, INPUT_PULLUP);
+  } else {
+    pinMode(pin, INPUT_PULLUP);
+  }
+}
+
+bool ReedSwitch::useInterrupts(McpInterrupts* a) {
+  if (i2cPins) {
+    if (a == nullptr || !(*a).watch(pin, &edges)) return false;
+    doorStatus = (*mcp).digitalRead(pin);
+  } else {
+    if (!attachEdgeInterrupt(pin, &edges)) return false;
+    doorStatus = digitalRead(pin);
+  }
+  edgeInput = true;
+  return true;
 }
 
 const char* ReedSwitch::state() {
@@ -31,6 +47,20 @@ int ReedSwitch::status() {
 }
 
 bool ReedSwitch::handle() {
+  if (edgeInput) {
+    // an open and close between two calls still counts as a change
+    bool changed = false;
+    InputEdge edge;
+    while (edges.pop(edge)) {
+      if (edge.level != doorStatus) {
+        doorStatus = edge.level;
+        changedMicros = edge.micros;
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
   int previousDoorStatus = doorStatus;
 
   if (i2cPins) {
@@ -0,0 +1,51 @@
+#ifndef MY_CLOCK_H
+#define MY_CLOCK_H
+
+#include <time.h>                       // time() ctime()
+
+// Where the relay library gets the current time from. Devices use the system
+// clock kept in sync by configTime(); host builds install their own source so
+// a simulation can run through days of schedules in seconds.
+typedef time_t (*ClockSource)();
+
+void setClockSource(ClockSource source);
+time_t clockNow();
+
+// The local time broken down once per loop tick and handed to every relay,
+// so they all decide on the same instant without each paying for a timezone
+// conversion.
+struct ClockSnapshot {
+  time_t epoch;
+  int wday;           // 0 = Sunday
+  int hour;
+  int minute;
+  int second;
+  int minuteOfDay;
+  time_t midnight;    // epoch of 00:00 today, local time
+};
+
+// Conversions are cached for the current minute, so calling these every pass
+// through loop() costs a localtime() at most once a minute.
+ClockSnapshot clockSnapshot();
+ClockSnapshot clockSnapshot(time_t epoch);
+
+// "7:15" as the minute of the day, or -1 if it isn't an h:mm time. It is
+// constexpr so a config table holds the number, worked out by the compiler,
+// and a static_assert can reject a bad time before it reaches a device.
+constexpr int minuteOfDay(const char* a) {
+  int hour = 0, minute = 0, digits = 0;
+  for (; *a >= '0' && *a <= '9'; a++, digits++) hour = hour * 10 + (*a - '0');
+  if (digits < 1 || digits > 2 || *a != ':') return -1;
+  a++;
+  digits = 0;
+  for (; *a >= '0' && *a <= '9'; a++, digits++) minute = minute * 10 + (*a - '0');
+  if (digits != 2 || *a != '\0' || hour > 23 || minute > 59) return -1;
+  return hour * 60 + minute;
+}
+
+// "mm/dd/yy hh:mm:ss" in local time, or "None" for 0. Returns buf so the
+// result can go straight into a JSON document, which copies a char*.
+#define PRETTY_TIME_SIZE 18
+char* formatTime(time_t t, char buf[PRETTY_TIME_SIZE]);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef MY_PINS_H
+#define MY_PINS_H
+
+#include <Arduino.h>
+#include <my_mcp.h>
+
+// Pin backends for the relay templates in my_relay.h. Each one has the same
+// four inline methods, so a BasicRelay<Pins> calls straight into the right
+// GPIO code without testing a flag or going through a virtual call, and
+// says with CYCLE_AT_SETUP whether setup() clicks the relay on and off once.
+//
+//   NativePins - the board's own GPIO, and the host build where the fake HAL
+//                provides pinMode() and friends
+//   McpPins    - a pin on an MCP23X17, through its McpPort shadow registers
+//   TeensyPins - Teensy GPIO with the core's fast read and write
+
+struct NativePins {
+  static const bool CYCLE_AT_SETUP = true;
+
+  void pinMode(uint8_t pin, uint8_t mode) { ::pinMode(pin, mode); }
+  void digitalWrite(uint8_t pin, uint8_t val) { ::digitalWrite(pin, val); }
+  int digitalRead(uint8_t pin) { return ::digitalRead(pin); }
+  void flush() {}
+};
+
+struct McpPins {
+  static const bool CYCLE_AT_SETUP = true;
+
+  McpPort* port;
+
+  //constructor
+  McpPins(McpPort* a = nullptr): port(a) {}
+
+  void pinMode(uint8_t pin, uint8_t mode) { (*port).pinMode(pin, mode); }
+  void digitalWrite(uint8_t pin, uint8_t val) { (*port).digitalWrite(pin, val); }
+  int digitalRead(uint8_t pin) { return (*port).digitalRead(pin); }
+  // expander writes wait for McpPort::sync(), send them now
+  void flush() { (*port).flush(); }
+};
+
+#ifdef TEENSYDUINO
+struct TeensyPins {
+  // the Teensy sketches' relays drive loads that would pulse on every boot
+  static const bool CYCLE_AT_SETUP = false;
+
+  void pinMode(uint8_t pin, uint8_t mode) { ::pinMode(pin, mode); }
+  void digitalWrite(uint8_t pin, uint8_t val) { digitalWriteFast(pin, val); }
+  int digitalRead(uint8_t pin) { return digitalReadFast(pin); }
+  void flush() {}
+};
+#endif
+
+#endif
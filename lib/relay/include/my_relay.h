@@ -3,6 +3,8 @@
 
 #ifdef ESP32
 #include <ESPmDNS.h>
+#elif defined(TEENSYDUINO)
+#include <TimeLib.h>
 #else
 #include <sys/time.h>                   // struct timeval
 #include <TZ.h>
@@ -10,59 +12,83 @@
 #endif
 
 #include <time.h>                       // time() ctime()
-#include <Array.h>
 #include <Wire.h>
-#include "Adafruit_MCP23X17.h"
-#include <Adafruit_ADS1X15.h>
+#include <my_mcp.h>
+#include <my_moisture.h>
 #include <my_veml.h>
+#include "my_clock.h"
+#include "my_pins.h"
+#include <my_inputs.h>
 
 //#include <Preferences.h>
 
-class Relay {
-  int onVal = HIGH;
-  int offVal = LOW;
-  Adafruit_MCP23X17* mcp;
-  bool i2cPins = false;
+#define TIME_LEFT_SIZE 8
+
+class RelayScheduler;
+
+// What every relay has, whatever its pins are on. The relay classes below
+// are templates on a pin backend from my_pins.h; the typedefs at the end of
+// this file name the usual ones, e.g. IrrigationRelay and McpIrrigationRelay.
+class RelayBase {
   const char* ntpServer = "pool.ntp.org";
   const long  gmtOffset_sec = 8*60*60*-1;
   const int   daylightOffset_sec = 3600;
 
-  protected:
-    int pin;
-    void internalOn();
-    void internalOff();
+  friend class RelayScheduler;
+  RelayScheduler* scheduler = nullptr;
 
-    // GPIO wrapper methods to eliminate i2cPins ternary duplication
-    void pinModeWrapper(uint8_t pin, uint8_t mode);
-    void digitalWriteWrapper(uint8_t pin, uint8_t val);
-    int digitalReadWrapper(uint8_t pin);
+  protected:
+    uint8_t pin;
+    uint8_t onVal = HIGH;
+    uint8_t offVal = LOW;
+    void deadlineChanged();
+    void configureClock();
 
   public:
     //variables
     bool on = false;
     bool scheduleOverride = false;
-    time_t onTime = 0;
+    time_t onTime = 0;        // 0 until the relay first switches
     time_t offTime = 0;
-    char prettyOffTime[18];
-    char prettyOnTime[18];
-    char name[32];
+    // not copied, so a string literal or a name from a config table
+    const char* name = "";
 
     //constructors
-    Relay (int a, bool backwards = false);
-    Relay (int a, Adafruit_MCP23X17* b, bool backwards = false);
+    RelayBase (int a, bool backwards = false);
 
     //destructor
-    virtual ~Relay();
+    virtual ~RelayBase();
 
     void setBackwards();
     void setScheduleOverride(bool a);
     bool getScheduleOverride();
     int status();
+    const char* state();
+    char* prettyOnTime(char buf[PRETTY_TIME_SIZE]);
+    char* prettyOffTime(char buf[PRETTY_TIME_SIZE]);
+
+    // periodic work and when it next needs doing, see my_scheduler.h
+    bool handle();
+    virtual bool handle(const ClockSnapshot& clock);
+    virtual time_t nextDeadline();
+};
+
+template <class Pins>
+class BasicRelay: public RelayBase {
+  protected:
+    Pins pins;
+    void internalOn();
+    void internalOff();
+
+  public:
+    //constructors
+    BasicRelay (int a, bool backwards = false);
+    BasicRelay (int a, Pins b, bool backwards = false);
+
     void setup(const char* a);
     void setup();
     void switchOn();
     void switchOff();
-    const char* state();
 };
 
 // Door state enumeration
@@ -70,64 +96,124 @@ enum DoorState {
   DOOR_OPEN = 0,
   DOOR_OPENING = 1,
   DOOR_CLOSED = 2,
-  DOOR_CLOSING = 3
+  DOOR_CLOSING = 3,
+  DOOR_UNKNOWN = 4
+};
+
+// A reed switch input that only changes once it has held a new level for
+// the debounce time. Readings can be polled levels or interrupt edges; in
+// both cases the time is when the raw level changed, in micros().
+struct DebouncedInput {
+  uint8_t level = HIGH;
+  uint8_t raw = HIGH;
+  unsigned long rawChangedUs = 0;
+  unsigned long changedUs = 0;    // when the raw edge that set level came in
+
+  // returns true when the debounced level changes
+  bool update(int reading, unsigned long us, unsigned long debounceUs);
 };
 
-class GarageDoorRelay: public Relay {
+template <class Pins>
+class BasicGarageDoorRelay: public BasicRelay<Pins> {
   bool useLeds = false;
   int DOOR_PIN;
   int REED_OPEN_PIN;
   int REED_CLOSED_PIN;
   int LED_OPEN_PIN;
   int LED_CLOSED_PIN;
+  DebouncedInput reedOpen;
+  DebouncedInput reedClosed;
+  EdgeRing openEdges;
+  EdgeRing closedEdges;
+  bool edgeInputs = false;
+  bool pulsing = false;
+  unsigned long pulseStartMs = 0;
+  unsigned long travelStartUs = 0;
+
+  void setLeds();
+  void seedReeds();
+
+  // members of a dependent base have to be named before the bodies can use them
+  typedef BasicRelay<Pins> Base;
 
   public:
+    using Base::onTime;
+    using Base::switchOn;
+    using Base::switchOff;
+
+    static const unsigned long PULSE_MS = 100;
+    static const unsigned long DEBOUNCE_MS = 50;
+
     //variables
-    DoorState doorState;
+    DoorState doorState = DOOR_UNKNOWN;
+    time_t lastChangeTime = 0;           // when doorState last changed
+    unsigned long lastTravelMillis = 0;  // how long the last open or close took
 
     //constructurs
-    GarageDoorRelay(int a, int b, int c );
-    GarageDoorRelay(int a, int b, int c, int d, int e );
-    GarageDoorRelay(int a, int b, int c, int d, int e, Adafruit_MCP23X17* f);
+    BasicGarageDoorRelay(int a, int b, int c );
+    BasicGarageDoorRelay(int a, int b, int c, int d, int e );
+    BasicGarageDoorRelay(int a, int b, int c, int d, int e, Pins f);
    
     int status();
     void setup(const char* a);
-    void operate();
+    // after setup(): take the reeds from interrupt edges instead of reading
+    // them every pass. The first form is for native pins, the second for
+    // reeds on the expander. Returns false and keeps polling if the pins
+    // can't interrupt.
+    bool useInterrupts();
+    bool useInterrupts(McpInterrupts* a);
+    // press the button; the loop releases it PULSE_MS later. Returns false
+    // while a press is still in progress.
+    bool operate();
+    bool isPulsing();
     const char* state();
-    bool handle();
+    using RelayBase::handle;
+    bool handle(const ClockSnapshot& clock) override;
+    time_t nextDeadline() override;
 };
 
-class TimerRelay: public Relay {
+template <class Pins>
+class BasicTimerRelay: public BasicRelay<Pins> {
+  typedef BasicRelay<Pins> Base;
 
   protected:
-    time_t now, prevTime = 0;
-    int minutes = 0, seconds = 0;
-    int secondsLeft = 0;
+    using Base::deadlineChanged;
+
+    time_t now = 0, prevTime = 0;
     int initialRunTime = 0;
+    bool scheduleChanged = true;
 
-    void setTimeLeftToRun();
-    void setNextTimeToRun();
-    virtual bool doHandle();
+    void setNextTimeToRun(const ClockSnapshot& clock, bool afterThisMinute);
+    virtual bool doHandle(const ClockSnapshot& clock);
     //Preferences preferences;
 
   public:
+    using Base::on;
+    using Base::onTime;
+    using Base::scheduleOverride;
+
+    static const uint8_t MAX_START_TIMES = 5;
+
     int runTime = 0;
     bool active = true;
     //bool active =  preferences.getBool("active", true);
-    char timeLeftToRun[8];
-    char nextTimeToRun[18];
-    Array<int,7> runDays;
-    Array<int,5> startTimesOfDay;
+    time_t nextStartTime = 0;
+    uint8_t runDays = 0;                       // bit n is day n, 0 = Sunday
+    uint8_t startTimeCount = 0;
+    uint16_t startTimesOfDay[MAX_START_TIMES]; // minute of the day, sorted
 
     //constructors
-    TimerRelay(int a, bool backwards = false);
-    TimerRelay (int a, Adafruit_MCP23X17* b, bool backwards = false);
+    BasicTimerRelay(int a, bool backwards = false);
+    BasicTimerRelay (int a, Pins b, bool backwards = false);
 
     void setActive();
     void setInActive();
     void setRuntime(int a);
     void setRuntimeMinutes(int a);
     int getSecondsLeft();
+    // " m:ss" left of the current run
+    char* timeLeftToRun(char buf[TIME_LEFT_SIZE]);
+    char* nextTimeToRun(char buf[PRETTY_TIME_SIZE]);
     void addTimeToRun(int a);
     void switchOn();
     void switchOff();
@@ -136,7 +222,7 @@ class TimerRelay: public Relay {
     void setEveryOtherDayOn();
     void setEveryDayOn();
     void setEveryDayOff();
-    void setDaysFromArray(Array<int,7> & array);
+    void setRunDays(uint8_t days);
     void setSpecificDayOn(int n);
     void getWeekSchedule(char weekSchedule[8]);
     int checkDayToRun(int weekDay);
@@ -144,23 +230,40 @@ class TimerRelay: public Relay {
     void checkStartTime(String &timesToStart);
     virtual bool isTimeToStart();
     bool isTimeToStop();
-    bool handle();
+    using RelayBase::handle;
+    bool handle(const ClockSnapshot& clock) override;
+    time_t nextDeadline() override;
 };
 
 //https://forum.arduino.cc/t/oop-using-vectors-in-classes/513920/4
 
 // TODO: method to display time left to run
 // TODO: status of next scheduled run time in days, hours, minutes
-class IrrigationRelay: public TimerRelay {
+template <class Pins>
+class BasicIrrigationRelay: public BasicTimerRelay<Pins> {
   int moisturePin;
-  bool i2cMoistureSensor = false;
   int moisturePercentageToRun = -1;
   // default limits - analog pin read frontyard
   int dryMoistureLevel = 660;
   int wetMoistureLevel = 330;
-  Adafruit_ADS1015 ads;     /* Use this for the 12-bit version */
+  // an ADS1015 channel shared with other zones, or else the analog pin
+  // read through this zone's own filter
+  MoistureSampler* moistureSampler = nullptr;
+  MoistureFilter moistureFilter;
+
+  typedef BasicTimerRelay<Pins> Base;
+
+  protected:
+    using Base::now;
+    using Base::prevTime;
+    using Base::doHandle;
 
   public:
+    using Base::on;
+    using Base::name;
+    using Base::scheduleOverride;
+    using Base::switchOff;
+
     bool dry = true;
     bool moistureSensor = false;
     int moisturePercentage = -1;
@@ -169,40 +272,103 @@ class IrrigationRelay: public TimerRelay {
     bool isTimeToStart() override;
 
     //constructors
-    IrrigationRelay (int a);
-    IrrigationRelay (int a, Adafruit_MCP23X17* b);
+    BasicIrrigationRelay (int a);
+    BasicIrrigationRelay (int a, Pins b);
     //"patio_pots",  7,       true,      "7:00",              3,            , '1111111'
-    IrrigationRelay (const char* a, int b, bool c, const char* d, int e, bool f, Adafruit_MCP23X17* g);
+    BasicIrrigationRelay (const char* a, int b, bool c, const char* d, int e, bool f, Pins g = Pins());
+    // the same with d as a minute of the day, from minuteOfDay()
+    BasicIrrigationRelay (const char* a, int b, bool c, int d, int e, bool f, Pins g = Pins());
 
     // turn on the moisture check at moisturePercentageToRun
     void setMoistureSensor(int a, int b);
-    void setMoistureSensor(uint8_t a, int b, int c);
+    // channel b of a sampler the loop runs
+    void setMoistureSensor(MoistureSampler* a, uint8_t b, int c);
     void setMoistureLimits(int a, int b);
     void checkMoisture();
     void setMoistureLevel(int n);
     const char* state();
-    bool handle();
+    using RelayBase::handle;
+    bool handle(const ClockSnapshot& clock) override;
+    time_t nextDeadline() override;
 };
 
+typedef BasicRelay<NativePins> Relay;
+typedef BasicRelay<McpPins> McpRelay;
+typedef BasicGarageDoorRelay<NativePins> GarageDoorRelay;
+typedef BasicGarageDoorRelay<McpPins> McpGarageDoorRelay;
+typedef BasicTimerRelay<NativePins> TimerRelay;
+typedef BasicTimerRelay<McpPins> McpTimerRelay;
+typedef BasicIrrigationRelay<NativePins> IrrigationRelay;
+typedef BasicIrrigationRelay<McpPins> McpIrrigationRelay;
+
+// the member definitions are in my_relay.cpp, instantiated there for each
+// backend
+extern template class BasicRelay<NativePins>;
+extern template class BasicRelay<McpPins>;
+extern template class BasicGarageDoorRelay<NativePins>;
+extern template class BasicGarageDoorRelay<McpPins>;
+extern template class BasicTimerRelay<NativePins>;
+extern template class BasicTimerRelay<McpPins>;
+extern template class BasicIrrigationRelay<NativePins>;
+extern template class BasicIrrigationRelay<McpPins>;
+
+#ifdef TEENSYDUINO
+typedef BasicRelay<TeensyPins> TeensyRelay;
+typedef BasicGarageDoorRelay<TeensyPins> TeensyGarageDoorRelay;
+typedef BasicTimerRelay<TeensyPins> TeensyTimerRelay;
+typedef BasicIrrigationRelay<TeensyPins> TeensyIrrigationRelay;
+extern template class BasicRelay<TeensyPins>;
+extern template class BasicGarageDoorRelay<TeensyPins>;
+extern template class BasicTimerRelay<TeensyPins>;
+extern template class BasicIrrigationRelay<TeensyPins>;
+#endif
+
+// on/off pairs per ScheduleRelay, even if each runs past midnight; override
+// with -D SCHEDULE_RELAY_MAX_SLOTS=n
+#ifndef SCHEDULE_RELAY_MAX_SLOTS
+#define SCHEDULE_RELAY_MAX_SLOTS 4
+#endif
+
+// Switches on and off at set times of day. The slots are kept as sorted,
+// non-overlapping [on, off) intervals, so the state the schedule wants at
+// any minute is a binary search away. handle() only does that when the next
+// boundary comes round: it works out the state for the time it is rather
+// than waiting for an exact on or off minute, so a relay booted or stalled
+// inside a window still ends up on. It only switches when the scheduled
+// state changes, so a manual switch holds until the next boundary.
 class ScheduleRelay: public Relay {
-  const int MAX_SLOTS = 4;
-  const int hourIndex = 0;
-  const int minuteIndex = 1;
-  int onTimes[4][2];
-  int offTimes[4][2];
-  int slotsTaken = -1;
+  // minutes of the day; a slot running past midnight is stored as two
+  struct Interval {
+    uint16_t start;
+    uint16_t end;
+  };
+  Interval intervals[SCHEDULE_RELAY_MAX_SLOTS * 2];
+  uint8_t intervalCount = 0;
+  bool scheduleChanged = true;
+  bool scheduledOn = false;
+  time_t nextChange = 0;
+
+  bool addInterval(uint16_t start, uint16_t end);
+  int findInterval(int minuteOfDay);
+  time_t boundaryTime(const ClockSnapshot& clock, int minute);
 
   protected:
-    time_t now, prevTime = 0;
-
-    bool findTime(int hour, int min, int timeArray[4][2] );
+    time_t now = 0, prevTime = 0;
 
   public:
     ScheduleRelay (int a);
 
     //on hour, on minute, off hour, off minute
     bool setOnOffTimes(int a, int b, int c, int d);
-    bool handle();
+    void clearOnOffTimes();
+    // what the schedule wants at a minute of the day
+    bool isScheduledOn(int minuteOfDay);
+    // the first on or off time after minuteOfDay, 1440 and up for tomorrow,
+    // or -1 with no schedule
+    int nextBoundary(int minuteOfDay);
+    using Relay::handle;
+    bool handle(const ClockSnapshot& clock) override;
+    time_t nextDeadline() override;
 };
 
 class DuskToDawnScheduleRelay: public ScheduleRelay {
@@ -221,7 +387,9 @@ class DuskToDawnScheduleRelay: public ScheduleRelay {
     bool setVemlLightSensor();
     void setNightOffOnHours(int a, int b);
     void setDusk(int a);
-    bool handle();
+    using ScheduleRelay::handle;
+    bool handle(const ClockSnapshot& clock) override;
+    time_t nextDeadline() override;
 };
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef MY_SCHEDULER_H
+#define MY_SCHEDULER_H
+
+#include "my_relay.h"
+
+typedef void (*RelayCallback)(RelayBase* relay);
+
+// Runs relays when they are due instead of calling handle() on every one of
+// them every pass through loop(). Relays sit in a min-heap keyed by
+// RelayBase::nextDeadline(); run() only pops the ones whose deadline has passed.
+//
+//   RelayScheduler scheduler;
+//   RelayScheduler::Entry scheduler_storage[8];
+//   scheduler.setStorage(scheduler_storage);
+//   scheduler.add(relay);
+//   ...
+//   scheduler.run(logChange);           // in loop()
+class RelayScheduler {
+  public:
+    struct Entry {
+      time_t deadline;
+      RelayBase* relay;
+    };
+
+    unsigned long dispatches = 0;
+
+    template <size_t MAX_SIZE>
+    void setStorage(Entry (&storage)[MAX_SIZE]) {
+      heap = storage;
+      capacity = MAX_SIZE;
+      size = 0;
+    }
+
+    bool add(RelayBase* relay);
+    void reschedule(RelayBase* relay);
+
+    // handle() every relay that is due, calling onChange for those that
+    // report a change. Returns the number of relays that changed.
+    int run(RelayCallback onChange = nullptr);
+
+    // earliest deadline in the queue
+    time_t nextDeadline();
+
+    // how long loop() can yield before anything is due; rounded down so a
+    // caller waking after this long is never late
+    unsigned long idleMillis();
+
+  private:
+    Entry* heap = nullptr;
+    size_t capacity = 0;
+    size_t size = 0;
+
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    void swap(size_t a, size_t b);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "my_clock.h"
+#include <string.h>
+
+#ifdef TEENSYDUINO
+#include <TimeLib.h>
+
+// the sketches set the RTC to local time from NTP
+static time_t systemClock() {
+  return Teensy3Clock.get();
+}
+#else
+static time_t systemClock() {
+  return time(nullptr);
+}
+#endif
+
+static ClockSource clockSource = systemClock;
+
+void setClockSource(ClockSource source) {
+  clockSource = source ? source : systemClock;
+}
+
+time_t clockNow() {
+  return clockSource();
+}
+
+ClockSnapshot clockSnapshot() {
+  return clockSnapshot(clockNow());
+}
+
+ClockSnapshot clockSnapshot(time_t epoch) {
+  // timezone offsets only change on the hour, so everything but the seconds
+  // holds for the rest of the minute
+  static ClockSnapshot cached = {};
+  static time_t cachedMinute = -1;
+
+  if (cachedMinute >= 0 && epoch >= cachedMinute && epoch < cachedMinute + 60) {
+    cached.epoch = epoch;
+    cached.second = epoch - cachedMinute;
+    return cached;
+  }
+
+  struct tm local;
+  localtime_r(&epoch, &local);
+  cached.epoch = epoch;
+  cached.wday = local.tm_wday;
+  cached.hour = local.tm_hour;
+  cached.minute = local.tm_min;
+  cached.second = local.tm_sec;
+  cached.minuteOfDay = local.tm_hour * 60 + local.tm_min;
+  cachedMinute = epoch - local.tm_sec;
+
+  // mktime() rather than subtracting the time of day, which is off by an
+  // hour on the days DST starts and ends
+  local.tm_hour = 0;
+  local.tm_min = 0;
+  local.tm_sec = 0;
+  local.tm_isdst = -1;
+  cached.midnight = mktime(&local);
+
+  return cached;
+}
+
+char* formatTime(time_t t, char buf[PRETTY_TIME_SIZE]) {
+  if (t == 0) {
+    strcpy(buf, "None");
+    return buf;
+  }
+
+  struct tm local;
+  localtime_r(&t, &local);
+  strftime(buf, PRETTY_TIME_SIZE, "%D %T", &local);
+  return buf;
+}
@@ -1,61 +1,28 @@
 #include "my_relay.h"
+#include "my_scheduler.h"
 
-// GPIO wrapper methods
-void Relay::pinModeWrapper(uint8_t pin, uint8_t mode) {
-  if (i2cPins) {
-    (*mcp).pinMode(pin, mode);
-  } else {
-    pinMode(pin, mode);
-  }
-}
-
-void Relay::digitalWriteWrapper(uint8_t pin, uint8_t val) {
-  if (i2cPins) {
-    (*mcp).digitalWrite(pin, val);
-  } else {
-    digitalWrite(pin, val);
-  }
-}
-
-int Relay::digitalReadWrapper(uint8_t pin) {
-  if (i2cPins) {
-    return (*mcp).digitalRead(pin);
-  } else {
-    return digitalRead(pin);
-  }
-}
-
-void Relay::internalOn() {
-  if (!on) {
-    digitalWriteWrapper(pin, onVal);
-    on = true;
-    onTime = time(nullptr);
-    struct tm *timeinfo = localtime(&onTime);
-    strftime (prettyOnTime,18,"%D %T",timeinfo);
-  }
+// RelayBase
+// let the scheduler re-key this relay after a change made outside handle(),
+// e.g. an HTTP request switching it on
+void RelayBase::deadlineChanged() {
+  if (scheduler) scheduler->reschedule(this);
 }
 
-void Relay::internalOff() {
-  if (on) {
-    digitalWriteWrapper(pin, offVal);
-    on = false;
-    offTime = time(nullptr);
-    struct tm *timeinfo = localtime(&offTime);
-    strftime (prettyOffTime,18,"%D %T",timeinfo);
+void RelayBase::configureClock() {
+  static bool ntpConfigured = false;
+  if (!ntpConfigured) {
+#ifdef ESP32
+    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+#elif !defined(TEENSYDUINO)
+    // a Teensy keeps time in its RTC, see my_clock.cpp
+    configTime(MYTZ, ntpServer);
+#endif
+    ntpConfigured = true;
   }
 }
 
 //constructors
-Relay::Relay (int a, bool backwards): pin(a) {
-  name[0] = '\0';
-  if (backwards) {
-    onVal = LOW;
-    offVal = HIGH;
-  }
-}
-
-Relay::Relay (int a, Adafruit_MCP23X17* b, bool backwards): mcp(b), i2cPins(true), pin(a) {
-  name[0] = '\0';
+RelayBase::RelayBase (int a, bool backwards): pin(a) {
   if (backwards) {
     onVal = LOW;
     offVal = HIGH;
@@ -63,22 +30,22 @@ Relay::Relay (int a, Adafruit_MCP23X17* b, bool backwards): mcp(b), i2cPins(true
 }
 
 //destructor
-Relay::~Relay() {}
+RelayBase::~RelayBase() {}
 
-void Relay::setBackwards() {
+void RelayBase::setBackwards() {
   onVal = LOW;
   offVal = HIGH;
 }
 
-void Relay::setScheduleOverride(bool a) {
+void RelayBase::setScheduleOverride(bool a) {
   scheduleOverride = a;
 }
 
-bool Relay::getScheduleOverride() {
+bool RelayBase::getScheduleOverride() {
   return scheduleOverride;
 }
 
-int Relay::status() {
+int RelayBase::status() {
   if (on) {
     return 1;
   } else {
@@ -86,347 +53,480 @@ int Relay::status() {
   }
 }
 
-void Relay::setup(const char* a) {
-  strncpy(name, a, sizeof(name) - 1);
-  name[sizeof(name) - 1] = '\0';
-  this->setup();
+const char* RelayBase::state() {
+  if (on) {
+    return "on";
+  } else { 
+    return "off";
+  }
 }
 
-void Relay::setup() {
-  pinModeWrapper(pin, OUTPUT);
-  digitalWriteWrapper(pin, offVal); // start off
+char* RelayBase::prettyOnTime(char buf[PRETTY_TIME_SIZE]) {
+  return formatTime(onTime, buf);
+}
 
-  // iterate through one on off cycle to work the kinks out
-  internalOn(); internalOff();
+char* RelayBase::prettyOffTime(char buf[PRETTY_TIME_SIZE]) {
+  return formatTime(offTime, buf);
+}
 
-  static bool ntpConfigured = false;
-  if (!ntpConfigured) {
-#ifdef ESP32
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-#else
-    configTime(MYTZ, ntpServer);
-#endif
-    ntpConfigured = true;
-  }
-  onTime = offTime = time(nullptr);
-  strcpy(prettyOnTime,"None");
-  strcpy(prettyOffTime,"None");
+bool RelayBase::handle() {
+  return handle(clockSnapshot());
 }
 
-void Relay::switchOn() {
-  internalOn();
+bool RelayBase::handle(const ClockSnapshot& /*clock*/) {
+  return false;
 }
 
-void Relay::switchOff() {
-  internalOff();
+// a deadline at or before now means handle() runs on every scheduler pass
+time_t RelayBase::nextDeadline() {
+  return 0;
 }
 
-const char* Relay::state() {
+// BasicRelay
+template <class Pins>
+void BasicRelay<Pins>::internalOn() {
+  if (!on) {
+    pins.digitalWrite(pin, onVal);
+    on = true;
+    onTime = clockNow();
+    deadlineChanged();
+  }
+}
+
+template <class Pins>
+void BasicRelay<Pins>::internalOff() {
   if (on) {
-    return "on";
-  } else { 
-    return "off";
+    pins.digitalWrite(pin, offVal);
+    on = false;
+    offTime = clockNow();
+    deadlineChanged();
   }
 }
 
+//constructors
+template <class Pins>
+BasicRelay<Pins>::BasicRelay (int a, bool backwards): RelayBase(a, backwards) {}
+
+template <class Pins>
+BasicRelay<Pins>::BasicRelay (int a, Pins b, bool backwards): RelayBase(a, backwards), pins(b) {}
+
+template <class Pins>
+void BasicRelay<Pins>::setup(const char* a) {
+  name = a;
+  this->setup();
+}
+
+template <class Pins>
+void BasicRelay<Pins>::setup() {
+  pins.digitalWrite(pin, offVal); // start off, latched before the pin drives
+  pins.pinMode(pin, OUTPUT);
+
+  // iterate through one on off cycle to work the kinks out
+  if (Pins::CYCLE_AT_SETUP) {
+    internalOn(); internalOff();
+    onTime = offTime = 0;
+  }
+
+  configureClock();
+}
+
+template <class Pins>
+void BasicRelay<Pins>::switchOn() {
+  internalOn();
+}
+
+template <class Pins>
+void BasicRelay<Pins>::switchOff() {
+  internalOff();
+}
+
 
 //constructors
-GarageDoorRelay::GarageDoorRelay(int a, int b, int c)
-  : GarageDoorRelay(a, b, c, 0, 0) {
+template <class Pins>
+BasicGarageDoorRelay<Pins>::BasicGarageDoorRelay(int a, int b, int c)
+  : BasicGarageDoorRelay(a, b, c, 0, 0) {
+  // the reed pull-ups are set in setup(), once the pins can be reached
   useLeds = false;
-  // Since the other end of the reed switch is connected to ground, we need
-  // to pull-up the reed switch pin internally.
-  pinMode(REED_OPEN_PIN, INPUT_PULLUP);
-  pinMode(REED_CLOSED_PIN, INPUT_PULLUP);
 }
 
-GarageDoorRelay::GarageDoorRelay(int a, int b, int c, int d, int e)
-  : Relay(a), DOOR_PIN(a), REED_OPEN_PIN(b), REED_CLOSED_PIN(c), LED_OPEN_PIN(d), LED_CLOSED_PIN(e), useLeds(true) {}
+template <class Pins>
+BasicGarageDoorRelay<Pins>::BasicGarageDoorRelay(int a, int b, int c, int d, int e)
+  : BasicRelay<Pins>(a), useLeds(true), DOOR_PIN(a), REED_OPEN_PIN(b), REED_CLOSED_PIN(c), LED_OPEN_PIN(d), LED_CLOSED_PIN(e) {}
 
-GarageDoorRelay::GarageDoorRelay(int a, int b, int c, int d, int e, Adafruit_MCP23X17* f)
-  : Relay(a, f), DOOR_PIN(a), REED_OPEN_PIN(b), REED_CLOSED_PIN(c), LED_OPEN_PIN(d), LED_CLOSED_PIN(e), useLeds(true) {}
+template <class Pins>
+BasicGarageDoorRelay<Pins>::BasicGarageDoorRelay(int a, int b, int c, int d, int e, Pins f)
+  : BasicRelay<Pins>(a, f), useLeds(true), DOOR_PIN(a), REED_OPEN_PIN(b), REED_CLOSED_PIN(c), LED_OPEN_PIN(d), LED_CLOSED_PIN(e) {}
 
-int GarageDoorRelay::status() {
+template <class Pins>
+int BasicGarageDoorRelay<Pins>::status() {
   return doorState;
 }
 
-void GarageDoorRelay::setup(const char* a) {
-  Relay::pin = DOOR_PIN;
-  Relay::setup(a);
+template <class Pins>
+void BasicGarageDoorRelay<Pins>::setup(const char* a) {
+  this->pin = DOOR_PIN;
+  BasicRelay<Pins>::setup(a);
 
   // Since the other end of the reed switch is connected to ground, we need
   // to pull-up the reed switch pin internally.
-  pinModeWrapper(REED_OPEN_PIN, INPUT_PULLUP);
-  pinModeWrapper(REED_CLOSED_PIN, INPUT_PULLUP);
+  this->pins.pinMode(REED_OPEN_PIN, INPUT_PULLUP);
+  this->pins.pinMode(REED_CLOSED_PIN, INPUT_PULLUP);
 
   if (useLeds) {
-    pinModeWrapper(LED_OPEN_PIN, OUTPUT);
-    pinModeWrapper(LED_CLOSED_PIN, OUTPUT);
+    this->pins.pinMode(LED_OPEN_PIN, OUTPUT);
+    this->pins.pinMode(LED_CLOSED_PIN, OUTPUT);
     // Set the LED's to off initially
-    digitalWriteWrapper(LED_OPEN_PIN, LOW);
-    digitalWriteWrapper(LED_CLOSED_PIN, LOW);
+    this->pins.digitalWrite(LED_OPEN_PIN, LOW);
+    this->pins.digitalWrite(LED_CLOSED_PIN, LOW);
+  }
+}
+
+template <class Pins>
+bool BasicGarageDoorRelay<Pins>::useInterrupts() {
+  if (!attachEdgeInterrupt(REED_OPEN_PIN, &openEdges)) return false;
+  if (!attachEdgeInterrupt(REED_CLOSED_PIN, &closedEdges)) {
+    detachEdgeInterrupt(REED_OPEN_PIN);
+    return false;
   }
+  seedReeds();
+  return true;
+}
+
+template <class Pins>
+bool BasicGarageDoorRelay<Pins>::useInterrupts(McpInterrupts* a) {
+  if (!(*a).watch(REED_OPEN_PIN, &openEdges)) return false;
+  if (!(*a).watch(REED_CLOSED_PIN, &closedEdges)) return false;
+  seedReeds();
+  return true;
+}
+
+// edges only report changes, so start from the levels the reeds have now
+template <class Pins>
+void BasicGarageDoorRelay<Pins>::seedReeds() {
+  unsigned long us = micros();
+  reedOpen.update(this->pins.digitalRead(REED_OPEN_PIN), us, DEBOUNCE_MS * 1000);
+  reedClosed.update(this->pins.digitalRead(REED_CLOSED_PIN), us, DEBOUNCE_MS * 1000);
+  edgeInputs = true;
 }
 
-void GarageDoorRelay::operate() {
-  onTime = time(nullptr);
+template <class Pins>
+bool BasicGarageDoorRelay<Pins>::operate() {
+  if (pulsing) return false;
+
   switchOn();
-  delay(100);
-  switchOff();
+  // an expander relay has to see the press now, not at the next sync
+  this->pins.flush();
+  pulsing = true;
+  pulseStartMs = millis();
+  return true;
+}
+
+template <class Pins>
+bool BasicGarageDoorRelay<Pins>::isPulsing() {
+  return pulsing;
 }
 
-const char* GarageDoorRelay::state() {
+template <class Pins>
+const char* BasicGarageDoorRelay<Pins>::state() {
   switch (doorState) {
     case DOOR_OPEN:    return "OPEN";
     case DOOR_OPENING: return "OPENING";
     case DOOR_CLOSED:  return "CLOSED";
     case DOOR_CLOSING: return "CLOSING";
+    case DOOR_UNKNOWN: break;
   }
   return "UNKNOWN";
 }
 
-bool GarageDoorRelay::handle() {
-  // Check to see if the door is open
-  int doorOpen = digitalReadWrapper(REED_OPEN_PIN);
-  if (doorOpen == LOW) { // Door detected is in the open position
-    if (doorState != DOOR_OPEN) {
-      if (useLeds) {
-        digitalWriteWrapper(LED_OPEN_PIN, HIGH); // Turn the LED on
-      }
-      doorState = DOOR_OPEN;
-      return true;
-    }
-  } else { // Door is not in the open position
-    if (doorState == DOOR_OPEN ) {
-      if (useLeds) {
-        digitalWriteWrapper(LED_OPEN_PIN, LOW); // Turn the LED off
-      }
-      doorState = DOOR_CLOSING;
-      return true;
-    }
+// the button pulse and the reed debounce are checked on every pass
+template <class Pins>
+time_t BasicGarageDoorRelay<Pins>::nextDeadline() {
+  return 0;
+}
+
+template <class Pins>
+void BasicGarageDoorRelay<Pins>::setLeds() {
+  if (!useLeds) return;
+
+  this->pins.digitalWrite(LED_OPEN_PIN, doorState == DOOR_OPEN ? HIGH : LOW);
+  if (LED_CLOSED_PIN) {
+    this->pins.digitalWrite(LED_CLOSED_PIN, doorState == DOOR_CLOSED ? HIGH : LOW);
   }
+}
 
-  int doorClosed = digitalReadWrapper(REED_CLOSED_PIN); // Check to see if the door is closed
-  if (doorClosed == LOW) { // Door detected in the closed position
-    if (doorState != DOOR_CLOSED) {
-      if (useLeds && LED_CLOSED_PIN) {
-        digitalWriteWrapper(LED_CLOSED_PIN, HIGH); // Turn the LED on
-      }
-      doorState = DOOR_CLOSED;
-      return true;
-    }
-  } else { // Door is not in the closed position
-    if (doorState == DOOR_CLOSED) {
-      if (useLeds && LED_CLOSED_PIN) {
-        digitalWriteWrapper(LED_CLOSED_PIN, LOW); // Turn the LED off
-      }
-      doorState = DOOR_OPENING;
-      return true;
-    }
+bool DebouncedInput::update(int reading, unsigned long us, unsigned long debounceUs) {
+  // a level held long enough counts even when the next edge is already in
+  bool changed = false;
+  if (raw != level && us - rawChangedUs >= debounceUs) {
+    level = raw;
+    changedUs = rawChangedUs;
+    changed = true;
   }
-  return false;
+  if (reading != raw) {
+    raw = reading;
+    rawChangedUs = us;
+  }
+  return changed;
+}
+
+template <class Pins>
+bool BasicGarageDoorRelay<Pins>::handle(const ClockSnapshot& clock) {
+  unsigned long ms = millis();
+  unsigned long us = micros();
+  const unsigned long debounceUs = DEBOUNCE_MS * 1000;
+
+  // finish a button press started by operate()
+  if (pulsing && ms - pulseStartMs >= PULSE_MS) {
+    switchOff();
+    this->pins.flush();
+    pulsing = false;
+  }
+
+  bool openChanged = false;
+  bool closedChanged = false;
+  if (edgeInputs) {
+    // replay the edges at the times they happened, then let the last one
+    // settle against now
+    InputEdge edge;
+    while (openEdges.pop(edge)) openChanged |= reedOpen.update(edge.level, edge.micros, debounceUs);
+    while (closedEdges.pop(edge)) closedChanged |= reedClosed.update(edge.level, edge.micros, debounceUs);
+    openChanged |= reedOpen.update(reedOpen.raw, us, debounceUs);
+    closedChanged |= reedClosed.update(reedClosed.raw, us, debounceUs);
+  } else {
+    openChanged = reedOpen.update(this->pins.digitalRead(REED_OPEN_PIN), us, debounceUs);
+    closedChanged = reedClosed.update(this->pins.digitalRead(REED_CLOSED_PIN), us, debounceUs);
+  }
+  if (!openChanged && !closedChanged && doorState != DOOR_UNKNOWN) return false;
+
+  // the reeds pull to ground when the door is against them
+  DoorState next;
+  if (reedOpen.level == LOW) {
+    next = DOOR_OPEN;
+  } else if (reedClosed.level == LOW) {
+    next = DOOR_CLOSED;
+  } else if (doorState == DOOR_OPEN) {
+    next = DOOR_CLOSING;
+  } else if (doorState == DOOR_CLOSED) {
+    next = DOOR_OPENING;
+  } else {
+    next = doorState;
+  }
+  if (next == doorState) return false;
+
+  // time travel from the edges rather than from when the loop saw them
+  unsigned long eventUs = openChanged ? reedOpen.changedUs : reedClosed.changedUs;
+  if (next == DOOR_OPENING || next == DOOR_CLOSING) {
+    travelStartUs = eventUs;
+  } else if (doorState == DOOR_OPENING || doorState == DOOR_CLOSING) {
+    lastTravelMillis = (eventUs - travelStartUs) / 1000;
+  }
+
+  doorState = next;
+  lastChangeTime = clock.epoch;
+  setLeds();
+  return true;
 }
 
 // TimerRelay constructors
-TimerRelay::TimerRelay(int a, bool backwards): Relay(a, backwards) {
+template <class Pins>
+BasicTimerRelay<Pins>::BasicTimerRelay(int a, bool backwards): BasicRelay<Pins>(a, backwards) {
   setEveryDayOn();
   //preferences.begin("TimerRelay", false);
 }
-TimerRelay::TimerRelay (int a, Adafruit_MCP23X17* b, bool backwards): Relay(a, b, backwards) {
+template <class Pins>
+BasicTimerRelay<Pins>::BasicTimerRelay (int a, Pins b, bool backwards): BasicRelay<Pins>(a, b, backwards) {
   setEveryDayOn();
   //preferences.begin("TimerRelay", false);
 }
 
-void TimerRelay::setTimeLeftToRun() {
-  if ( on ) { 
-    secondsLeft = runTime - (now - onTime);
-    minutes = secondsLeft / 60;
-    seconds = secondsLeft % 60;
-  } else {
-    minutes = 0;
-    seconds = 0;
-  }
-  sprintf(timeLeftToRun, "%2d:%02d", minutes, seconds);
+template <class Pins>
+char* BasicTimerRelay<Pins>::timeLeftToRun(char buf[TIME_LEFT_SIZE]) {
+  int secondsLeft = getSecondsLeft();
+  snprintf(buf, TIME_LEFT_SIZE, "%2d:%02d", (secondsLeft / 60) % 100, secondsLeft % 60);
+  return buf;
 }
 
-void TimerRelay::setNextTimeToRun() {
-  struct tm *timeinfo = localtime(&now);
-  int thisDay = timeinfo->tm_wday;
-  int thisHour = timeinfo->tm_hour;
-  int thisMinute = timeinfo->tm_min;
-  int thisSecond = timeinfo->tm_sec;
+template <class Pins>
+char* BasicTimerRelay<Pins>::nextTimeToRun(char buf[PRETTY_TIME_SIZE]) {
+  return formatTime(nextStartTime, buf);
+}
+
+// Work out the first scheduled start from the clock's minute on (or from the
+// minute after it, once a run has fired) and cache it, so the per-second tick
+// only has to compare two time_t's.
+template <class Pins>
+void BasicTimerRelay<Pins>::setNextTimeToRun(const ClockSnapshot& clock, bool afterThisMinute) {
+  nextStartTime = 0;
+  scheduleChanged = false;
 
   // if there are no start times set, just return
-  if ( startTimesOfDay.size() == 0 ) {
+  if ( startTimeCount == 0 ) {
     return;
   }
 
-  int currMinuteOfDay = (thisHour * 60) + thisMinute;
+  int firstMinuteOfDay = clock.minuteOfDay + (afterThisMinute ? 1 : 0);
 
-  int startMinute = 0;
-  int n;
-  for ( n=0 ; n<7 ; n++ ) {
-    int dayFromThisDay = (n + thisDay) % 7;
+  // look a full week ahead so a single run day still finds next week's start
+  for ( int n=0 ; n<=7 ; n++ ) {
+    int dayFromThisDay = (n + clock.wday) % 7;
 
     // Skip checking this day if we're not scheduled to run
-    if (! runDays[dayFromThisDay]) continue;
+    if (! checkDayToRun(dayFromThisDay)) continue;
 
-    //check each startTime(inMinutes)
-    for (int i = 0; i < int(startTimesOfDay.size()); i++) {
+    // the start times are sorted, so the first one not already gone is next
+    int startMinute = -1;
+    for (int i = 0; i < startTimeCount; i++) {
       // if it's today but the time we're looking at was before now, skip it
-      if ( (dayFromThisDay == thisDay) && (startTimesOfDay[i] < currMinuteOfDay) ) continue;
-      // if we found a start time already and this one is bigger, skip it and keep the one we have
-      if ( startMinute && startTimesOfDay[i] > startMinute ) continue;
-
+      if ( n == 0 && startTimesOfDay[i] < firstMinuteOfDay ) continue;
       startMinute = startTimesOfDay[i];
+      break;
     }
 
-    if ( startMinute ) {
-      //                 (midnight of today) + (days from this day) + (the start time) 
-      time_t startTime = (now - currMinuteOfDay*60 - thisSecond) + (n*24*60*60) + startMinute*60;
-      struct tm *timeinfo = localtime(&startTime);
-      strftime (nextTimeToRun,18,"%D %T",timeinfo);
+    if ( startMinute >= 0 ) {
+      // let mktime() do the calendar math so DST changes land on the right
+      // hour; this only runs when the schedule changes or a run fires
+      struct tm start;
+      localtime_r(&clock.midnight, &start);
+      start.tm_mday += n;
+      start.tm_hour = startMinute / 60;
+      start.tm_min = startMinute % 60;
+      start.tm_sec = 0;
+      start.tm_isdst = -1;
+      nextStartTime = mktime(&start);
       return;
-    } 
+    }
   }
 }
 
-void TimerRelay::setActive() {
+template <class Pins>
+void BasicTimerRelay<Pins>::setActive() {
   active = true;
   //preferences.putBool("active", active);
 }
 
-void TimerRelay::setInActive() {
+template <class Pins>
+void BasicTimerRelay<Pins>::setInActive() {
   active = false;
   //preferences.putBool("active", active);
 }
 
-void TimerRelay::setRuntime(int a) {
+template <class Pins>
+void BasicTimerRelay<Pins>::setRuntime(int a) {
   initialRunTime = a;
 }
 
-void TimerRelay::setRuntimeMinutes(int a) {
+template <class Pins>
+void BasicTimerRelay<Pins>::setRuntimeMinutes(int a) {
   initialRunTime = a*60;
 }
 
-int TimerRelay::getSecondsLeft() {
-  return secondsLeft;
+template <class Pins>
+int BasicTimerRelay<Pins>::getSecondsLeft() {
+  if ( !on ) return 0;
+
+  // read from the clock rather than the last tick, this is asked for by
+  // HTTP handlers between ticks
+  int secondsLeft = runTime - (clockNow() - onTime);
+  return secondsLeft > 0 ? secondsLeft : 0;
 }
 
-void TimerRelay::addTimeToRun(int a) {
+template <class Pins>
+void BasicTimerRelay<Pins>::addTimeToRun(int a) {
   runTime += a;
   if (!on) {
-    Relay::switchOn();
+    BasicRelay<Pins>::switchOn();
   }
-  setTimeLeftToRun();
+  // the stop time moved
+  deadlineChanged();
 }
 
-void TimerRelay::switchOn() {
+template <class Pins>
+void BasicTimerRelay<Pins>::switchOn() {
   runTime = initialRunTime;
-  Relay::switchOn();
+  BasicRelay<Pins>::switchOn();
 }
 
-void TimerRelay::switchOff() {
+template <class Pins>
+void BasicTimerRelay<Pins>::switchOff() {
   runTime = 0;
-  Relay::switchOff();
+  BasicRelay<Pins>::switchOff();
 } 
 
-bool TimerRelay::setStartTimeFromString(const char *a) {
-  if (  startTimesOfDay.full() ) { return false; }
+// "7:00", "18:30"
+template <class Pins>
+bool BasicTimerRelay<Pins>::setStartTimeFromString(const char *a) {
+  const char* colon = strchr(a, ':');
+  return setStartTime(atoi(a), colon ? atoi(colon + 1) : 0);
+}
+
+template <class Pins>
+bool BasicTimerRelay<Pins>::setStartTime(int a, int b) {
+  if ( startTimeCount == MAX_START_TIMES ) return false;
 
-  bool processMinutes = false;
-  char hours[3];
-  char minutes[3];
-  int n = 0;
-  for (int i = 0; a[i] != '\0'; i++)
-  {
-    if (!processMinutes)
-    {
-      hours[n++] = a[i];
-
-      if (a[i] == ':')
-      {
-	processMinutes = true;
-	n = 0;
-	continue;
-      }
-    }
-    else
-    {
-      minutes[n++] = a[i];
-    }
+  // insert in order so the next start is the first one not already gone
+  uint16_t startMinuteOfDay = a * 60 + b;
+  int i = startTimeCount++;
+  while ( i > 0 && startTimesOfDay[i - 1] > startMinuteOfDay ) {
+    startTimesOfDay[i] = startTimesOfDay[i - 1];
+    i--;
   }
-  int startMinuteOfDay = atoi(hours) * 60 + atoi(minutes);
-  startTimesOfDay.push_back(startMinuteOfDay);
+  startTimesOfDay[i] = startMinuteOfDay;
+
+  scheduleChanged = true;
+  deadlineChanged();
   return true;
 }
 
-bool TimerRelay::setStartTime(int a, int b) {
-  int startMinuteOfDay = a * 60 + b;
-  if (!startTimesOfDay.full())
-  {
-    startTimesOfDay.push_back(startMinuteOfDay);
-    return true;
-  }
-  return false;
+// Sunday, Tuesday, Thursday and Saturday
+template <class Pins>
+void BasicTimerRelay<Pins>::setEveryOtherDayOn() {
+  setRunDays(0x55);
 }
 
-void TimerRelay::setEveryOtherDayOn() {
-  for (int n = 0; n < 7; n++)
-  {
-    if (n % 2 == 0)
-    {
-      runDays[n] = 1;
-    }
-    else
-    {
-      runDays[n] = 0;
-    }
-  }
+template <class Pins>
+void BasicTimerRelay<Pins>::setEveryDayOn() {
+  setRunDays(0x7f);
 }
 
-void TimerRelay::setEveryDayOn() {
-  for ( int n=0 ; n<7 ; n++ ) {
-    runDays[n] = 1;
-  }
+template <class Pins>
+void BasicTimerRelay<Pins>::setEveryDayOff() {
+  setRunDays(0);
 }
 
-void TimerRelay::setEveryDayOff() {
-  for ( int n=0 ; n<7 ; n++ ) {
-    runDays[n] = 0;
-  }
+template <class Pins>
+void BasicTimerRelay<Pins>::setRunDays(uint8_t days) {
+  runDays = days & 0x7f;
+  scheduleChanged = true;
+  deadlineChanged();
 }
 
-void TimerRelay::setDaysFromArray(Array<int,7> & array) {
-  for ( int n=0 ; n<7 ; n++ ) {
-    runDays[n] = array[n];
-  }
-} 
-
-void TimerRelay::setSpecificDayOn(int n) {
-  runDays[n] = 1;
+template <class Pins>
+void BasicTimerRelay<Pins>::setSpecificDayOn(int n) {
+  setRunDays(runDays | (1 << n));
 }
 
-void TimerRelay::getWeekSchedule(char weekSchedule[8]) {
+template <class Pins>
+void BasicTimerRelay<Pins>::getWeekSchedule(char weekSchedule[8]) {
   for ( int n=0 ; n<7 ; n++ ) {
-    if (runDays[n] == 0) { weekSchedule[n] = '_'; }
+    if (checkDayToRun(n) == 0) { weekSchedule[n] = '_'; }
     else { weekSchedule[n] = 'R'; }
   }
   weekSchedule[7] = '\0';
 }
 
-int TimerRelay::checkDayToRun(int thisDay) { 
-  return runDays[thisDay];
+template <class Pins>
+int BasicTimerRelay<Pins>::checkDayToRun(int thisDay) { 
+  return (runDays >> thisDay) & 1;
 } 
 
-int TimerRelay::checkDayToRun() { 
-  struct tm *timeinfo = localtime(&now);
-  int thisDay = timeinfo->tm_wday;
-  return runDays[thisDay];
+template <class Pins>
+int BasicTimerRelay<Pins>::checkDayToRun() { 
+  return checkDayToRun(clockSnapshot(now).wday);
 } 
 
-void TimerRelay::checkStartTime(String &timesToStart) {
-  for (int i = 0; i < int(startTimesOfDay.size()); i++) {
+template <class Pins>
+void BasicTimerRelay<Pins>::checkStartTime(String &timesToStart) {
+  for (int i = 0; i < startTimeCount; i++) {
     if (i != 0) {
       timesToStart += ", ";
     }
@@ -434,29 +534,26 @@ void TimerRelay::checkStartTime(String &timesToStart) {
   }
 }
 
-bool TimerRelay::isTimeToStart() {
-  time_t now = time(nullptr);
-  struct tm *timeinfo = localtime(&now);
-  int thisHour = timeinfo->tm_hour;
-  int thisMinute = timeinfo->tm_min;
-  int thisDay = timeinfo->tm_wday;
+template <class Pins>
+bool BasicTimerRelay<Pins>::isTimeToStart() {
+  if ( nextStartTime == 0 ) return false;
 
-  for (int i = 0; i < int(startTimesOfDay.size()); i++) {
-    if (runDays[thisDay] && (((thisHour * 60) + thisMinute) == startTimesOfDay[i]) ) {
-      // don't run twice in the same minute
-      if (now - onTime > 60) return true;
-    } 
-  }
-  return false;
+  // start any time during the scheduled minute, but don't run twice in it
+  return now >= nextStartTime && now < nextStartTime + 60 && now - onTime > 60;
 }
 
-bool TimerRelay::isTimeToStop() {
+template <class Pins>
+bool BasicTimerRelay<Pins>::isTimeToStop() {
   return now >= onTime + runTime;
 }
 
-bool TimerRelay::doHandle() {
-  setTimeLeftToRun();
-  setNextTimeToRun();
+template <class Pins>
+bool BasicTimerRelay<Pins>::doHandle(const ClockSnapshot& clock) {
+  // only redo the calendar math when the schedule changed or the start
+  // minute has gone by without a run
+  if ( scheduleChanged || ( nextStartTime && now >= nextStartTime + 60 ) ) {
+    setNextTimeToRun(clock, false);
+  }
 
   if ( initialRunTime == 0 ) return false;
 
@@ -470,66 +567,102 @@ bool TimerRelay::doHandle() {
   if ( !on && isTimeToStart() ) {
     if (!active) return false;
     switchOn();
+    setNextTimeToRun(clock, true);
     return true;
   }
 
   return false;
 }
 
-bool TimerRelay::handle() {
+template <class Pins>
+bool BasicTimerRelay<Pins>::handle(const ClockSnapshot& clock) {
   prevTime = now;
-  now = time(nullptr);
+  now = clock.epoch;
 
   if ( now == prevTime ) return false;
 
-  return doHandle();
+  return doHandle(clock);
+}
+
+template <class Pins>
+time_t BasicTimerRelay<Pins>::nextDeadline() {
+  // never handled or the start time needs working out again
+  if ( now == 0 || scheduleChanged ) return 0;
+
+  // nothing to do until the run is over
+  if ( on ) return onTime + runTime > now ? onTime + runTime : now + 1;
+
+  // nothing scheduled; look again in an hour in case the clock jumped
+  if ( nextStartTime == 0 ) return now + 3600;
+
+  // inside the start minute a skipped start can still happen
+  if ( now >= nextStartTime ) return now + 1;
+
+  return nextStartTime;
 }
 
 // IrrigationRelay constructors
-IrrigationRelay::IrrigationRelay (int a): TimerRelay(a) { }
-IrrigationRelay::IrrigationRelay (int a, Adafruit_MCP23X17* b): TimerRelay(a, b) { }
+template <class Pins>
+BasicIrrigationRelay<Pins>::BasicIrrigationRelay (int a): BasicTimerRelay<Pins>(a) { }
+template <class Pins>
+BasicIrrigationRelay<Pins>::BasicIrrigationRelay (int a, Pins b): BasicTimerRelay<Pins>(a, b) { }
 //"patio_pots",  7,       true,      "7:00",              3,            , '1111111'
-IrrigationRelay::IrrigationRelay (const char* a, int b, bool c, const char* d, int e, bool f, Adafruit_MCP23X17* g): TimerRelay(b, g, c) {
-  strncpy(name, a, sizeof(name) - 1);
-  name[sizeof(name) - 1] = '\0';
+template <class Pins>
+BasicIrrigationRelay<Pins>::BasicIrrigationRelay (const char* a, int b, bool c, const char* d, int e, bool f, Pins g): BasicTimerRelay<Pins>(b, g, c) {
+  name = a;
   this->setStartTimeFromString(d);
   this->setRuntimeMinutes(e);
   if (f) { this->setEveryOtherDayOn(); }
 }
+template <class Pins>
+BasicIrrigationRelay<Pins>::BasicIrrigationRelay (const char* a, int b, bool c, int d, int e, bool f, Pins g): BasicTimerRelay<Pins>(b, g, c) {
+  name = a;
+  this->setStartTime(d / 60, d % 60);
+  this->setRuntimeMinutes(e);
+  if (f) { this->setEveryOtherDayOn(); }
+}
 
 // IrrigationRelay methods
 // turn on the moisture check at moisturePercentageToRun
-void IrrigationRelay::setMoistureSensor(int a, int b) {
+template <class Pins>
+void BasicIrrigationRelay<Pins>::setMoistureSensor(int a, int b) {
   moistureSensor = true;
   moisturePin = a;
   moisturePercentageToRun = b;
 }
 
-void IrrigationRelay::setMoistureSensor(uint8_t a, int b, int c) {
+template <class Pins>
+void BasicIrrigationRelay<Pins>::setMoistureSensor(MoistureSampler* a, uint8_t b, int c) {
   moistureSensor = true;
-  i2cMoistureSensor = true;
-  ads.begin(a);
+  moistureSampler = a;
+  (*moistureSampler).watch(b);
   moisturePin = b;
   moisturePercentageToRun = c;
 }
 
-void IrrigationRelay::setMoistureLimits(int a, int b) {
+template <class Pins>
+void BasicIrrigationRelay<Pins>::setMoistureLimits(int a, int b) {
   dryMoistureLevel = a;
   wetMoistureLevel = b;
 }
 
-void IrrigationRelay::setMoistureLevel(int n) {
+template <class Pins>
+void BasicIrrigationRelay<Pins>::setMoistureLevel(int n) {
   moistureLevel = n;
 }
 
-void IrrigationRelay::checkMoisture() {
-  if (i2cMoistureSensor) {
-    moistureLevel = ads.readADC_SingleEnded(moisturePin);
+template <class Pins>
+void BasicIrrigationRelay<Pins>::checkMoisture() {
+  if (moistureSampler) {
+    moistureLevel = (*moistureSampler).level(moisturePin);
   } else {
-    moistureLevel = analogRead(moisturePin);
+    moistureFilter.add(analogRead(moisturePin));
+    moistureLevel = moistureFilter.level();
   }
+  // no reading yet, keep the last decision
+  if (moistureLevel < 0) return;
 
-  double calibratedMoistureLevel = moistureLevel;
+  int calibratedMoistureLevel = moistureLevel;
 
   if (calibratedMoistureLevel > dryMoistureLevel) {
     calibratedMoistureLevel = dryMoistureLevel;
@@ -538,12 +671,15 @@ void IrrigationRelay::checkMoisture() {
     calibratedMoistureLevel = wetMoistureLevel;
   }
 
-  moisturePercentage = 100 - (((calibratedMoistureLevel - wetMoistureLevel) / (dryMoistureLevel - wetMoistureLevel)) * 100);
+  // rounded to the nearest percent
+  int range = dryMoistureLevel - wetMoistureLevel;
+  moisturePercentage = 100 - ((calibratedMoistureLevel - wetMoistureLevel) * 100 + range / 2) / range;
 
   dry = (moisturePercentage < moisturePercentageToRun) ?  true : false;
 }
 
-const char* IrrigationRelay::state() {
+template <class Pins>
+const char* BasicIrrigationRelay<Pins>::state() {
   if (! dry) return "wet";
 
   if (on)
@@ -556,13 +692,23 @@ const char* IrrigationRelay::state() {
   }
 }
 
-bool IrrigationRelay::isTimeToStart() {
-  return dry && TimerRelay::isTimeToStart();
+template <class Pins>
+bool BasicIrrigationRelay<Pins>::isTimeToStart() {
+  return dry && BasicTimerRelay<Pins>::isTimeToStart();
+}
+
+template <class Pins>
+time_t BasicIrrigationRelay<Pins>::nextDeadline() {
+  // the moisture sensor is sampled every second
+  if ( moistureSensor ) return now + 1;
+
+  return BasicTimerRelay<Pins>::nextDeadline();
 }
 
-bool IrrigationRelay::handle() {
+template <class Pins>
+bool BasicIrrigationRelay<Pins>::handle(const ClockSnapshot& clock) {
   prevTime = now;
-  now = time(nullptr);
+  now = clock.epoch;
 
   if ( now == prevTime ) return false;
 
@@ -574,51 +720,144 @@ bool IrrigationRelay::handle() {
     return true;
   }
 
-  return doHandle();
+  return doHandle(clock);
 }
 
-bool ScheduleRelay::findTime(int hour, int min, int timeArray[4][2] ) {
-  for (int i = 0; i <= slotsTaken; i++) {
-    if (timeArray[i][hourIndex] == hour && timeArray[i][minuteIndex] == min) {
-      return true;
-    }
+ScheduleRelay::ScheduleRelay (int a): Relay(a) {}
+
+// Insert [start, end) keeping the list sorted, folding in any intervals it
+// overlaps or touches.
+bool ScheduleRelay::addInterval(uint16_t start, uint16_t end) {
+  int first = 0;
+  while ( first < intervalCount && intervals[first].end < start ) first++;
+
+  int last = first;
+  while ( last < intervalCount && intervals[last].start <= end ) {
+    if ( intervals[last].start < start ) start = intervals[last].start;
+    if ( intervals[last].end > end ) end = intervals[last].end;
+    last++;
   }
-  return false;
-}
 
-ScheduleRelay::ScheduleRelay (int a): Relay(a) {}
+  int merged = last - first;
+  if ( merged == 0 && intervalCount == SCHEDULE_RELAY_MAX_SLOTS * 2 ) return false;
+
+  // close or open the gap between the kept intervals and the new one
+  int shift = 1 - merged;
+  if ( shift > 0 ) {
+    for (int i = intervalCount - 1; i >= last; i--) intervals[i + shift] = intervals[i];
+  } else if ( shift < 0 ) {
+    for (int i = last; i < intervalCount; i++) intervals[i + shift] = intervals[i];
+  }
+  intervalCount += shift;
+
+  intervals[first].start = start;
+  intervals[first].end = end;
+  return true;
+}
 
 //on hour, on minute, off hour, off minute
 bool ScheduleRelay::setOnOffTimes(int a, int b, int c, int d) {
-  if (slotsTaken == MAX_SLOTS) {
+  uint16_t onMinute = a * 60 + b;
+  uint16_t offMinute = c * 60 + d;
+  if ( onMinute == offMinute || onMinute >= 24 * 60 || offMinute >= 24 * 60 ) return false;
+
+  // a wrapping slot needs room for both halves before either goes in
+  Interval saved[SCHEDULE_RELAY_MAX_SLOTS * 2];
+  uint8_t savedCount = intervalCount;
+  memcpy(saved, intervals, sizeof(intervals));
+
+  bool added;
+  if ( onMinute < offMinute ) {
+    added = addInterval(onMinute, offMinute);
+  } else {
+    added = addInterval(onMinute, 24 * 60) && ( offMinute == 0 || addInterval(0, offMinute) );
+  }
+  if ( !added ) {
+    memcpy(intervals, saved, sizeof(intervals));
+    intervalCount = savedCount;
     return false;
   }
-  slotsTaken++;
-
-  onTimes[slotsTaken][hourIndex] = a;
-  onTimes[slotsTaken][minuteIndex] = b;
-  offTimes[slotsTaken][hourIndex] = c;
-  offTimes[slotsTaken][minuteIndex] = d;
 
+  scheduleChanged = true;
+  deadlineChanged();
   return true;
 }
 
-bool ScheduleRelay::handle() {
+void ScheduleRelay::clearOnOffTimes() {
+  intervalCount = 0;
+  scheduleChanged = true;
+  deadlineChanged();
+}
+
+// index of the last interval starting at or before minuteOfDay, or -1
+int ScheduleRelay::findInterval(int minuteOfDay) {
+  int lo = 0, hi = intervalCount;
+  while ( lo < hi ) {
+    int mid = (lo + hi) / 2;
+    if ( intervals[mid].start <= minuteOfDay ) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo - 1;
+}
+
+bool ScheduleRelay::isScheduledOn(int minuteOfDay) {
+  int i = findInterval(minuteOfDay);
+  return i >= 0 && minuteOfDay < intervals[i].end;
+}
+
+int ScheduleRelay::nextBoundary(int minuteOfDay) {
+  if ( intervalCount == 0 ) return -1;
+
+  int i = findInterval(minuteOfDay);
+  if ( i >= 0 && minuteOfDay < intervals[i].end ) return intervals[i].end;
+  if ( i + 1 < intervalCount ) return intervals[i + 1].start;
+  return intervals[0].start + 24 * 60;
+}
+
+// mktime() so the boundary lands on the right hour across a DST change
+time_t ScheduleRelay::boundaryTime(const ClockSnapshot& clock, int minute) {
+  struct tm boundary;
+  localtime_r(&clock.midnight, &boundary);
+  boundary.tm_hour = 0;
+  boundary.tm_min = minute;
+  boundary.tm_sec = 0;
+  boundary.tm_isdst = -1;
+  return mktime(&boundary);
+}
+
+time_t ScheduleRelay::nextDeadline() {
+  if ( now == 0 || scheduleChanged ) return 0;
+  return nextChange;
+}
+
+bool ScheduleRelay::handle(const ClockSnapshot& clock) {
   prevTime = now;
-  now = time(nullptr);
-  if ( ( now == prevTime ) || ( now % 5 != 0 ) ) return false;
+  now = clock.epoch;
+  if ( now == prevTime ) return false;
 
-  if ( scheduleOverride )  return false;
+  // nothing to do between boundaries, unless the clock was set back
+  if ( !scheduleChanged && now >= prevTime && now < nextChange ) return false;
 
-  struct tm *timeinfo = localtime(&now);
-  int thisHour = timeinfo->tm_hour;
-  int thisMinute = timeinfo->tm_min;
-  if ( ! on && findTime(thisHour, thisMinute, onTimes) ) {
+  bool wanted = isScheduledOn(clock.minuteOfDay);
+  bool changed = scheduleChanged || wanted != scheduledOn;
+  scheduledOn = wanted;
+  scheduleChanged = false;
+
+  int boundary = nextBoundary(clock.minuteOfDay);
+  // with nothing scheduled look again in an hour
+  nextChange = boundary < 0 ? now + 3600 : boundaryTime(clock, boundary);
+
+  if ( !changed || scheduleOverride ) return false;
+
+  if ( wanted && !on ) {
     switchOn();
     return true;
   }
 
-  if ( on && findTime(thisHour, thisMinute, offTimes) ) {
+  if ( !wanted && on ) {
     switchOff();
     return true;
   }
@@ -645,23 +884,34 @@ void DuskToDawnScheduleRelay::setNightOffOnHours(int a, int b) {
 
 void DuskToDawnScheduleRelay::setDusk(int a) {
   dusk = a;
+  // keep the sensor's fine range around the threshold
+  veml.fineLux = 3 * dusk;
 }
 
-bool DuskToDawnScheduleRelay::handle() {
+// light levels are sampled on 5 second boundaries
+time_t DuskToDawnScheduleRelay::nextDeadline() {
+  return now - now % 5 + 5;
+}
+
+bool DuskToDawnScheduleRelay::handle(const ClockSnapshot& clock) {
   prevTime = now;
-  now = time(nullptr);
+  now = clock.epoch;
   if ( ( now == prevTime ) || ( now % 5 != 0 ) ) return false;
 
   if (vemlSensor) {
-    lightLevel = veml.readLux();
+    // the last finished sample; waiting out an integration here would
+    // hold up everything else in the loop
+    veml.handle();
+    // nothing to go on until the first integration is done
+    if (veml.lux < 0) return false;
+    lightLevel = veml.lux;
   }
 
   if ( scheduleOverride ) {
     return false; 
   }
 
-  struct tm *timeinfo = localtime(&now);
-  int thisHour = timeinfo->tm_hour;
+  int thisHour = clock.hour;
   // Switch on criteria: it's dark, the lights are not on and it's not the middle of the night
   if ( lightLevel < dusk && ! on && !( thisHour >= nightOffHour && thisHour <= morningOnHour ) ) {
     timesLight = 0;
@@ -687,3 +937,18 @@ bool DuskToDawnScheduleRelay::handle() {
   return false;
 }
 
+template class BasicRelay<NativePins>;
+template class BasicRelay<McpPins>;
+template class BasicGarageDoorRelay<NativePins>;
+template class BasicGarageDoorRelay<McpPins>;
+template class BasicTimerRelay<NativePins>;
+template class BasicTimerRelay<McpPins>;
+template class BasicIrrigationRelay<NativePins>;
+template class BasicIrrigationRelay<McpPins>;
+
+#ifdef TEENSYDUINO
+template class BasicRelay<TeensyPins>;
+template class BasicGarageDoorRelay<TeensyPins>;
+template class BasicTimerRelay<TeensyPins>;
+template class BasicIrrigationRelay<TeensyPins>;
+#endif
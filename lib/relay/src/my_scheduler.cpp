@@ -0,0 +1,101 @@
+#include "my_scheduler.h"
+
+void RelayScheduler::swap(size_t a, size_t b) {
+  Entry tmp = heap[a];
+  heap[a] = heap[b];
+  heap[b] = tmp;
+}
+
+void RelayScheduler::siftUp(size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap[parent].deadline <= heap[i].deadline) return;
+    swap(i, parent);
+    i = parent;
+  }
+}
+
+void RelayScheduler::siftDown(size_t i) {
+  for (;;) {
+    size_t smallest = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < size && heap[left].deadline < heap[smallest].deadline) smallest = left;
+    if (right < size && heap[right].deadline < heap[smallest].deadline) smallest = right;
+    if (smallest == i) return;
+    swap(i, smallest);
+    i = smallest;
+  }
+}
+
+bool RelayScheduler::add(RelayBase* relay) {
+  if (size == capacity) return false;
+
+  relay->scheduler = this;
+  heap[size].relay = relay;
+  heap[size].deadline = relay->nextDeadline();
+  siftUp(size++);
+  return true;
+}
+
+void RelayScheduler::reschedule(RelayBase* relay) {
+  // a relay being dispatched by run() isn't in the heap; it gets its new
+  // deadline when run() puts it back
+  for (size_t i = 0; i < size; i++) {
+    if (heap[i].relay != relay) continue;
+
+    time_t deadline = relay->nextDeadline();
+    time_t previous = heap[i].deadline;
+    heap[i].deadline = deadline;
+    if (deadline < previous) {
+      siftUp(i);
+    } else {
+      siftDown(i);
+    }
+    return;
+  }
+}
+
+int RelayScheduler::run(RelayCallback onChange) {
+  time_t now = clockNow();
+  if (size == 0 || heap[0].deadline > now) return 0;
+
+  // every relay due this pass sees the same instant
+  ClockSnapshot clock = clockSnapshot(now);
+  int changed = 0;
+
+  // Pop everything that is due into the slots past the end of the heap so a
+  // relay that is due again straight away isn't run twice in one pass.
+  size_t total = size;
+  while (size > 0 && heap[0].deadline <= now) {
+    swap(0, --size);
+    siftDown(0);
+  }
+
+  for (size_t i = size; i < total; i++) {
+    RelayBase* relay = heap[i].relay;
+    dispatches++;
+    if (relay->handle(clock)) {
+      changed++;
+      if (onChange) onChange(relay);
+    }
+  }
+
+  while (size < total) {
+    heap[size].deadline = heap[size].relay->nextDeadline();
+    siftUp(size++);
+  }
+
+  return changed;
+}
+
+time_t RelayScheduler::nextDeadline() {
+  return size > 0 ? heap[0].deadline : 0;
+}
+
+unsigned long RelayScheduler::idleMillis() {
+  if (size == 0) return 0;
+
+  time_t wait = heap[0].deadline - clockNow() - 1;
+  return wait > 0 ? (unsigned long) wait * 1000 : 0;
+}
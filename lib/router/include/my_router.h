@@ -0,0 +1,175 @@
+#ifndef MY_ROUTER_H
+#define MY_ROUTER_H
+#include <Arduino.h>
+#include <Syslog.h>
+
+#ifndef ROUTE_MAX_PARAMS
+#define ROUTE_MAX_PARAMS 4
+#endif
+#ifndef ROUTE_VALUE_SIZE
+#define ROUTE_VALUE_SIZE 24        // longer text values are cut short
+#endif
+
+// a whole array, for the tables below
+#define ROUTE_TABLE(a) a, (uint8_t) (sizeof(a) / sizeof(a[0]))
+
+// a command that runs for any allowed value of its parameter
+#define ROUTE_ANY -1
+
+// One query parameter of an endpoint. With choices its value has to be one
+// of those words and is kept as the index into them, which the sketch names
+// with an enum; without, it is kept as text. An empty value counts as
+// missing.
+struct RouteParam {
+  const char* name;
+  const char* const* choices;
+  uint8_t choiceCount;
+};
+
+// A query parsed against an endpoint's parameters, indexed like them.
+class RouteArgs {
+  public:
+    static const int8_t MISSING = -2;
+    static const int8_t INVALID = -3;   // given, but not one of the choices
+
+    // for the commands, like the zone the query named
+    void* context = nullptr;
+
+    //constructor
+    RouteArgs();
+
+    bool has(uint8_t p) const { return choices[p] >= 0; }
+    // the index of the choice, MISSING or INVALID
+    int8_t choice(uint8_t p) const { return choices[p]; }
+    const char* text(uint8_t p) const { return values[p]; }
+    long toInt(uint8_t p) const { return atol(values[p]); }
+
+    void set(uint8_t p, const RouteParam& param, const char* value);
+
+  private:
+    int8_t choices[ROUTE_MAX_PARAMS];
+    char values[ROUTE_MAX_PARAMS][ROUTE_VALUE_SIZE];
+};
+
+// Runs when parameter param was given as choice, or as anything allowed
+// with ROUTE_ANY.
+struct RouteCommand {
+  uint8_t param;
+  int8_t choice;
+  void (*run)(RouteArgs& args);
+};
+
+// An endpoint: the parameters it takes and its commands, tried in order.
+struct Route {
+  const RouteParam* params;
+  uint8_t paramCount;
+  const RouteCommand* commands;
+  uint8_t commandCount;
+  const char* unknown;             // sent as a 404 when no command matches
+
+  // the index of the parameter called name, -1 if there is none
+  int8_t find(const char* name) const;
+  const RouteCommand* match(const RouteArgs& args) const;
+};
+
+// /debug?level=, the same on every device
+enum DebugLevel : int8_t { LEVEL_0, LEVEL_1, LEVEL_2, LEVEL_STATUS };
+extern const char* const DEBUG_LEVELS[4];
+extern const RouteParam DEBUG_PARAMS[1];
+
+// state=on|off|status, for the relay endpoints
+enum SwitchChoice : int8_t { SWITCH_ON, SWITCH_OFF, SWITCH_STATUS };
+extern const char* const SWITCH_CHOICES[3];
+
+// Parses the query of the request being handled once, in one pass over its
+// arguments, and dispatches on it through a Route's table instead of a
+// chain of server.arg() comparisons.
+//
+//   const RouteParam MISTER_PARAMS[] = { { "state", ROUTE_TABLE(SWITCH_CHOICES) } };
+//   const RouteCommand MISTER_COMMANDS[] = {
+//     { 0, SWITCH_STATUS, sendMisterState },
+//     { 0, ROUTE_ANY, switchMister },
+//   };
+//   const Route MISTER_ROUTE = { ROUTE_TABLE(MISTER_PARAMS), ROUTE_TABLE(MISTER_COMMANDS), "ERROR: unknown mister command" };
+//
+//   void handleMister() { router.dispatch(MISTER_ROUTE); }
+//
+// Exactly one response goes out per request: the command's, or the 404.
+template <class Server>
+class CommandRouter {
+  public:
+    Server& server;
+
+    //constructor
+    CommandRouter(Server& a): server(a) {}
+
+    void parse(const Route& route, RouteArgs& args) {
+      for (int i = 0; i < server.args(); i++) {
+        int8_t p = route.find(server.argName(i).c_str());
+        if (p >= 0) args.set(p, route.params[p], server.arg(i).c_str());
+      }
+    }
+
+    // for a query parsed already, so a handler can look up args.context
+    // in between; unknown, when given, replaces route.unknown, like a
+    // message that names what the context turned out to be
+    bool run(const Route& route, RouteArgs& args, const char* unknown = nullptr) {
+      const RouteCommand* command = route.match(args);
+      if (!command) {
+        server.send(404, "text/plain", unknown ? unknown : route.unknown);
+        return false;
+      }
+      command->run(args);
+      return true;
+    }
+
+    // context is handed to the command, like the relay the endpoint is for
+    bool dispatch(const Route& route, void* context = nullptr) {
+      RouteArgs args;
+      args.context = context;
+      parse(route, args);
+      return run(route, args);
+    }
+
+    // /debug?level= as every device serves it: sets level and logs the
+    // change to log, a Syslog or a LogQueue, or sends it back for status
+    //
+    //   void handleDebug() { router.dispatchDebug(debug, syslog); }
+    template <class Log>
+    bool dispatchDebug(int& level, Log& log) {
+      static const RouteCommand commands[] = {
+        { 0, LEVEL_STATUS, sendDebugLevel<Log> },
+        { 0, ROUTE_ANY, setDebugLevel<Log> },
+      };
+      static const Route route = { ROUTE_TABLE(DEBUG_PARAMS), ROUTE_TABLE(commands), "ERROR: unknown debug command" };
+
+      DebugRequest<Log> request = { server, level, log };
+      return dispatch(route, &request);
+    }
+
+  private:
+    template <class Log>
+    struct DebugRequest {
+      Server& server;
+      int& level;
+      Log& log;
+    };
+
+    template <class Log>
+    static void setDebugLevel(RouteArgs& args) {
+      DebugRequest<Log>& request = *static_cast<DebugRequest<Log>*>(args.context);
+      request.level = args.choice(0);
+      request.log.logf(LOG_INFO, "Debug level %d", request.level);
+      request.server.send(200, "text/plain");
+    }
+
+    template <class Log>
+    static void sendDebugLevel(RouteArgs& args) {
+      DebugRequest<Log>& request = *static_cast<DebugRequest<Log>*>(args.context);
+      char msg[40];
+      sprintf(msg, "Debug level: %d", request.level);
+      request.server.send(200, "text/plain", msg);
+    }
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "my_router.h"
+
+const char* const DEBUG_LEVELS[4] = { "0", "1", "2", "status" };
+const RouteParam DEBUG_PARAMS[1] = { { "level", ROUTE_TABLE(DEBUG_LEVELS) } };
+const char* const SWITCH_CHOICES[3] = { "on", "off", "status" };
+
+RouteArgs::RouteArgs() {
+  for (uint8_t p = 0; p < ROUTE_MAX_PARAMS; p++) {
+    choices[p] = MISSING;
+    values[p][0] = '\0';
+  }
+}
+
+void RouteArgs::set(uint8_t p, const RouteParam& param, const char* value) {
+  if (p >= ROUTE_MAX_PARAMS || value[0] == '\0') return;
+
+  strncpy(values[p], value, ROUTE_VALUE_SIZE - 1);
+  values[p][ROUTE_VALUE_SIZE - 1] = '\0';
+
+  if (!param.choices) {
+    choices[p] = 0;
+    return;
+  }
+  // against the whole value, not the copy that may have been cut short
+  choices[p] = INVALID;
+  for (uint8_t c = 0; c < param.choiceCount; c++) {
+    if (strcmp(value, param.choices[c]) == 0) {
+      choices[p] = c;
+      return;
+    }
+  }
+}
+
+int8_t Route::find(const char* name) const {
+  for (uint8_t p = 0; p < paramCount; p++) {
+    if (strcmp(name, params[p].name) == 0) return p;
+  }
+  return -1;
+}
+
+const RouteCommand* Route::match(const RouteArgs& args) const {
+  for (uint8_t i = 0; i < commandCount; i++) {
+    const RouteCommand& command = commands[i];
+    if (!args.has(command.param)) continue;
+    if (command.choice == ROUTE_ANY || command.choice == args.choice(command.param)) return &command;
+  }
+  return nullptr;
+}
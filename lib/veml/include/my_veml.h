@@ -2,20 +2,50 @@
 #define MYVEML_H
 #include <Adafruit_VEML7700.h>
 
+// The VEML7700 integrates continuously, and the driver's readLux() sleeps
+// until a whole integration has finished since its last read (up to 1.6s at
+// 800ms). Veml never waits: handle() collects a result once an integration
+// period has gone by and publishes it in lux, and everything else reads
+// that. Call handle() from the loop, or from whatever needs a fresh value.
+//
+// Gain and integration time are picked for each sample from the one before.
+// Above fineLux the sensor runs at 25ms with the most gain that won't
+// saturate; below it, where a dusk threshold sits, it takes the finest
+// resolution that still fits even if that means 800ms.
 class Veml {
   Adafruit_VEML7700 veml = Adafruit_VEML7700();
+  unsigned long conversionStartMs = 0;
+  uint8_t gainIndex = 0;
+  uint8_t itIndex = 0;
+
+  void setRange(uint8_t g, uint8_t i);
+  double resolution(uint8_t g, uint8_t i);
+  bool chooseRange(double estimate);
 
   public:
     //constructor
     Veml ();
 
     // public variables
-    int integrationTime = 0;
+    int integrationTime = 0;       // ms, of the current range
     double gain = 0;
     bool initialized = false;
+    int lux = -1;                  // latest sample, -1 until the first one
+    unsigned long sampleMs = 0;    // millis() when lux was read
+    unsigned long samples = 0;
+    unsigned long rangeChanges = 0;
+    // at most one sample per interval, however short the integration
+    unsigned long sampleIntervalMs = 1000;
+    // below this the resolution matters more than the time a sample takes
+    int fineLux = 200;
 
     // public functions
     bool setup();
+    // true when a new sample was published
+    bool handle();
+    // ms since lux was read
+    unsigned long sampleAge();
+    // the cached sample, refreshed first if one is ready; never blocks
     int readLux();
 };
 #endif
@@ -1,30 +1,28 @@
 #include "my_veml.h"
 
+// ranges from least to most sensitive
+static const uint8_t GAIN_CODES[] = { VEML7700_GAIN_1_8, VEML7700_GAIN_1_4, VEML7700_GAIN_1, VEML7700_GAIN_2 };
+static const double GAIN_VALUES[] = { .125, .25, 1, 2 };
+static const uint8_t IT_CODES[] = { VEML7700_IT_25MS, VEML7700_IT_50MS, VEML7700_IT_100MS,
+                                    VEML7700_IT_200MS, VEML7700_IT_400MS, VEML7700_IT_800MS };
+static const int IT_VALUES[] = { 25, 50, 100, 200, 400, 800 };
+static const uint8_t NUM_GAINS = sizeof(GAIN_CODES);
+static const uint8_t NUM_ITS = sizeof(IT_CODES);
+
+// lux per count at gain 2 and 800ms, as the driver uses
+static const double MAX_RESOLUTION = 0.0036;
+// keep readings under this many counts so a brightening sky doesn't clip
+static const double HEADROOM_COUNTS = 65535 * 0.8;
+static const uint16_t SATURATED_COUNTS = 65000;
+
 //constructor
 Veml::Veml () {}
 
 bool Veml::setup() {
 
   if (veml.begin()) {
-    veml.setGain(VEML7700_GAIN_1);
-    veml.setIntegrationTime(VEML7700_IT_800MS);
-
-    switch (veml.getGain()) {
-      case VEML7700_GAIN_1: gain = 1; break;
-      case VEML7700_GAIN_2: gain = 2; break;
-      case VEML7700_GAIN_1_4: gain = .25; break;
-      case VEML7700_GAIN_1_8: gain = .125; break;
-    }
-
-    Serial.print(F("Integration Time (ms): "));
-    switch (veml.getIntegrationTime()) {
-      case VEML7700_IT_25MS: integrationTime = 25; break;
-      case VEML7700_IT_50MS: integrationTime = 50; break;
-      case VEML7700_IT_100MS: integrationTime = 100; break;
-      case VEML7700_IT_200MS: integrationTime = 200; break;
-      case VEML7700_IT_400MS: integrationTime = 400; break;
-      case VEML7700_IT_800MS: integrationTime = 800; break;
-    }
+    // start insensitive and fast; the first sample picks the real range
+    setRange(0, 0);
     veml.setLowThreshold(10000);
     veml.setHighThreshold(20000);
     veml.interruptEnable(false);
@@ -35,10 +33,85 @@ bool Veml::setup() {
   return initialized;
 }
 
-int Veml::readLux() {
-  if ( initialized ) {
-    return veml.readLux();
-  } else { 
-    return -1;
+double Veml::resolution(uint8_t g, uint8_t i) {
+  return MAX_RESOLUTION * (800.0 / IT_VALUES[i]) * (2.0 / GAIN_VALUES[g]);
+}
+
+void Veml::setRange(uint8_t g, uint8_t i) {
+  gainIndex = g;
+  itIndex = i;
+  veml.setGain(GAIN_CODES[g]);
+  // don't let the driver sleep out the old integration
+  veml.setIntegrationTime(IT_CODES[i], false);
+  gain = GAIN_VALUES[g];
+  integrationTime = IT_VALUES[i];
+  // the first result in the new range is ready one integration from now
+  conversionStartMs = millis();
+}
+
+// returns true if the range changed
+bool Veml::chooseRange(double estimate) {
+  uint8_t bestGain = 0;
+  uint8_t bestIt = 0;
+
+  if (estimate >= fineLux) {
+    // bright: the shortest integration, with the most gain that fits
+    for (uint8_t g = 0; g < NUM_GAINS; g++) {
+      if (estimate < HEADROOM_COUNTS * resolution(g, 0)) bestGain = g;
+    }
+  } else {
+    // near dark: the finest resolution that fits, shorter on a tie
+    double best = 0;
+    for (uint8_t i = 0; i < NUM_ITS; i++) {
+      for (uint8_t g = 0; g < NUM_GAINS; g++) {
+        double res = resolution(g, i);
+        if (estimate >= HEADROOM_COUNTS * res) continue;
+        if (best == 0 || res < best) {
+          best = res;
+          bestGain = g;
+          bestIt = i;
+        }
+      }
+    }
   }
+
+  if (bestGain == gainIndex && bestIt == itIndex) return false;
+  setRange(bestGain, bestIt);
+  rangeChanges++;
+  return true;
+}
+
+bool Veml::handle() {
+  if ( !initialized ) return false;
+  unsigned long ms = millis();
+  if ( ms - conversionStartMs < (unsigned long) integrationTime ) return false;
+  if ( samples > 0 && ms - sampleMs < sampleIntervalMs ) return false;
+
+  // a whole integration has finished, so the register already holds it
+  uint16_t counts = veml.readALS();
+  conversionStartMs = ms;
+
+  // clipped: drop to the least sensitive range and try again
+  if ( counts >= SATURATED_COUNTS && (gainIndex != 0 || itIndex != 0) ) {
+    setRange(0, 0);
+    rangeChanges++;
+    return false;
+  }
+
+  double measured = counts * resolution(gainIndex, itIndex);
+  lux = (int) (measured + 0.5);
+  sampleMs = ms;
+  samples++;
+
+  chooseRange(measured);
+  return true;
+}
+
+unsigned long Veml::sampleAge() {
+  return millis() - sampleMs;
+}
+
+int Veml::readLux() {
+  handle();
+  return lux;
 }